@@ -0,0 +1,40 @@
+#include "asgard/allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local size_t nb_allocations = 0;
+
+void* counted_malloc(std::size_t size) {
+    ++nb_allocations;
+    if (size == 0) {
+        size = 1;
+    }
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_malloc(size); }
+void* operator new[](std::size_t size) { return counted_malloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace asgard {
+
+namespace allocation_counter {
+
+size_t get_nb_allocations() {
+    return nb_allocations;
+}
+
+} // namespace allocation_counter
+
+} // namespace asgard
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+namespace asgard {
+
+namespace allocation_counter {
+
+// Number of heap allocations done by the calling thread since its start.
+// Only counted in the executables linking allocation_counter.cpp, which replaces the global operator new.
+size_t get_nb_allocations();
+
+} // namespace allocation_counter
+
+} // namespace asgard
@@ -19,67 +19,283 @@
 #include "utils/exception.h"
 #include "utils/zmq.h"
 
+#include "asgard/allocation_counter.h"
 #include "asgard/asgard_conf.h"
+#include "asgard/bounded_queue.h"
 #include "asgard/metrics.h"
+#include "asgard/mode_costing.h"
+#include "asgard/preprojection.h"
 #include "asgard/projector.h"
+#include "asgard/projector_snapshot.h"
 #include "asgard/request.pb.h"
+#include "asgard/request_capture.h"
+#include "asgard/thread_pool.h"
+#include "asgard/tile_profile.h"
 
+#include <google/protobuf/arena.h>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 using namespace valhalla;
 
+namespace {
+
+// A request waiting for a worker.
+// The envelope holds the routing frames of the client, they are sent back untouched with the response
+struct Job {
+    std::vector<zmq::message_t> envelope;
+    zmq::message_t request;
+};
+
+using JobQueue = asgard::BoundedQueue<Job>;
+
+const char* const RESPONSES_SOCKET = "inproc://responses";
+
+// A client asks for the cells of its matrix by chunks with this frame just before the request.
+// The frame is part of the envelope, so it comes back with every chunk
+const std::string STREAM_FRAME = "stream";
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
+}
+
+void save_projector_cache(const asgard::Projector& projector,
+                          const std::string& path,
+                          const std::string& tileset_version,
+                          valhalla::baldr::GraphReader& graph) {
+    // The periodic thread and the exit can save at the same time, the saves are made one after the other
+    static std::mutex save_mutex;
+    std::lock_guard<std::mutex> lock(save_mutex);
+    const auto start = boost::posix_time::microsec_clock::universal_time();
+    const auto nb_entries = asgard::projector_snapshot::save(projector, path, tileset_version, graph);
+    const auto duration = boost::posix_time::microsec_clock::universal_time() - start;
+    LOG_INFO("Projector snapshot: " + std::to_string(nb_entries) + " entries saved in " +
+             std::to_string(duration.total_milliseconds()) + "ms");
+}
+
+// Project every stop of the list for every mode, then flag asgard as ready
+void preproject_stops(const asgard::AsgardConf& conf,
+                      const asgard::Projector& projector,
+                      valhalla::baldr::GraphReader& graph,
+                      const asgard::Metrics& metrics) {
+    const size_t PREPROJECTION_CHUNK_SIZE = 1000;
+
+    const auto start = boost::posix_time::microsec_clock::universal_time();
+    const auto stops = asgard::preprojection::read_stop_list(conf.stop_list_path);
+    std::vector<std::string> modes;
+    boost::split(modes, conf.preprojection_modes, boost::is_any_of(","), boost::token_compress_on);
+    modes.erase(std::remove(modes.begin(), modes.end(), ""), modes.end());
+    if (stops.size() * modes.size() > conf.cache_size) {
+        LOG_WARN("The projector cache is too small to keep the " + std::to_string(stops.size() * modes.size()) + " pre-projections");
+    }
+
+    const auto nb_threads = conf.nb_preprojection_threads > 0 ? conf.nb_preprojection_threads : std::max(1u, std::thread::hardware_concurrency());
+    asgard::ThreadPool pool(nb_threads);
+    LOG_INFO("Pre-projecting " + std::to_string(stops.size()) + " stops for " + std::to_string(modes.size()) +
+             " modes on " + std::to_string(nb_threads) + " threads");
+
+    size_t last_percent = 0;
+    const auto nb_projected = asgard::preprojection::preproject(projector, stops, modes, graph, pool, PREPROJECTION_CHUNK_SIZE,
+                                                                [&](size_t done, size_t total) {
+                                                                    const auto percent = done * 100 / total;
+                                                                    if (percent / 10 > last_percent / 10) {
+                                                                        LOG_INFO("Pre-projection: " + std::to_string(percent) + "%");
+                                                                    }
+                                                                    last_percent = percent;
+                                                                });
+
+    const auto duration = boost::posix_time::microsec_clock::universal_time() - start;
+    LOG_INFO("Pre-projection done: " + std::to_string(nb_projected) + " projections in " +
+             std::to_string(duration.total_milliseconds()) + "ms");
+    metrics.set_ready(true);
+}
+
+// Load the hottest tiles of the previous runs, up to a part of the tile cache:
+// when the cache is full, the handlers clear it.
+void warmup_hottest_tiles(const std::vector<std::pair<uint64_t, uint64_t>>& hottest_tiles,
+                          valhalla::baldr::GraphReader& graph,
+                          size_t tile_cache_budget,
+                          const asgard::Metrics& metrics) {
+    const double WARMUP_CACHE_RATIO = 0.8;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    metrics.observe_tile_warmup(0, hottest_tiles.size(), 0);
+    const auto nb_loaded = asgard::warmup_tiles(graph, hottest_tiles, tile_cache_budget * WARMUP_CACHE_RATIO,
+                                                [&](size_t loaded, size_t total) {
+                                                    metrics.observe_tile_warmup(loaded, total, elapsed());
+                                                });
+    metrics.observe_tile_warmup(nb_loaded, hottest_tiles.size(), elapsed());
+    LOG_INFO("Tile warmup: " + std::to_string(nb_loaded) + "/" + std::to_string(hottest_tiles.size()) +
+             " tiles loaded in " + std::to_string(static_cast<int>(elapsed() * 1000)) + "ms");
+}
+
+void save_tile_profile(const asgard::ProjectionTileProfile& tile_profile, const std::string& path) {
+    // The periodic thread and the exit can save at the same time, the saves are made one after the other
+    static std::mutex save_mutex;
+    std::lock_guard<std::mutex> lock(save_mutex);
+    if (tile_profile.save(path)) {
+        LOG_INFO("Projection tile profile saved in " + path);
+    }
+}
+
+} // namespace
+
+// Serialize the response in a single pass: ByteSizeLong() caches the size of every
+// sub message, so the serialization doesn't have to compute them again
+static void serialize(const pbnavitia::Response& response, zmq::message_t& reply) {
+    const auto size = response.ByteSizeLong();
+    reply.rebuild(size);
+    response.SerializeWithCachedSizesToArray(static_cast<google::protobuf::uint8*>(reply.data()));
+}
+
 static void respond(zmq::socket_t& socket,
-                    const std::string& address,
-                    const pbnavitia::Response& response) {
-    zmq::message_t reply(response.ByteSize());
+                    std::vector<zmq::message_t>& envelope,
+                    const pbnavitia::Response& response,
+                    const asgard::Metrics& metrics) {
+    asgard::PhaseTimer timer(metrics);
+    zmq::message_t reply;
     try {
-        response.SerializeToArray(reply.data(), response.ByteSize());
+        serialize(response, reply);
     } catch (const google::protobuf::FatalException& e) {
         pbnavitia::Response error_response;
         error_response.mutable_error()->set_id(pbnavitia::Error::internal_error);
         error_response.mutable_error()->set_message(e.what());
-        reply.rebuild(error_response.ByteSize());
-        error_response.SerializeToArray(reply.data(), error_response.ByteSize());
+        serialize(error_response, reply);
+    }
+    timer.finish(asgard::Phase::serialize);
+    for (auto& frame : envelope) {
+        socket.send(frame, ZMQ_SNDMORE);
     }
-    z_send(socket, address, ZMQ_SNDMORE);
-    z_send(socket, "", ZMQ_SNDMORE);
     socket.send(reply);
 }
 
-static void worker(const asgard::Context& context) {
+// Sending a frame empties it, so each chunk of a streamed response is sent with a copy of the envelope
+static std::vector<zmq::message_t> copy_envelope(const std::vector<zmq::message_t>& envelope) {
+    std::vector<zmq::message_t> copy(envelope.size());
+    for (size_t i = 0; i < envelope.size(); ++i) {
+        copy[i].copy(&envelope[i]);
+    }
+    return copy;
+}
+
+static bool asks_for_stream(const std::vector<zmq::message_t>& envelope) {
+    return !envelope.empty() && envelope.back().size() == STREAM_FRAME.size() &&
+           std::memcmp(envelope.back().data(), STREAM_FRAME.data(), STREAM_FRAME.size()) == 0;
+}
+
+// Workers don't talk to the clients: they take their jobs from the queue and
+// push the serialized responses to the main thread through a DEALER socket.
+// So a worker never waits for a handshake and is ready for the next job as soon as it has replied.
+static void worker(const asgard::Context& context, JobQueue& jobs, size_t arena_size, asgard::RequestRecorder* recorder) {
     zmq::context_t& zmq_context = context.zmq_context;
     asgard::Handler handler(context);
 
-    zmq::socket_t socket(zmq_context, ZMQ_REQ);
-    socket.connect("inproc://workers");
-    z_send(socket, "READY");
+    zmq::socket_t socket(zmq_context, ZMQ_DEALER);
+    socket.connect(RESPONSES_SOCKET);
 
-    while (true) {
+    // The request and the response are allocated on an arena starting with a buffer owned by the worker.
+    // Resetting the arena keeps this buffer, so it is reused from one request to the next.
+    std::vector<char> arena_buffer(arena_size);
+    google::protobuf::ArenaOptions arena_options;
+    arena_options.initial_block = arena_buffer.data();
+    arena_options.initial_block_size = arena_buffer.size();
+    google::protobuf::Arena arena(arena_options);
 
-        const std::string address = z_recv(socket);
+    while (true) {
+        auto job = jobs.pop();
+        if (recorder != nullptr) {
+            recorder->record(job.request.data(), job.request.size());
+        }
+        const auto nb_allocations = asgard::allocation_counter::get_nb_allocations();
         {
-            std::string empty = z_recv(socket);
-            assert(empty.size() == 0);
+            asgard::InFlightGuard in_flight_guard(context.metrics.start_in_flight());
+            auto* pb_req = google::protobuf::Arena::Create<pbnavitia::Request>(&arena);
+            auto* response = google::protobuf::Arena::Create<pbnavitia::Response>(&arena);
+            asgard::PhaseTimer timer(context.metrics);
+            const bool parsed = pb_req->ParseFromArray(job.request.data(), job.request.size());
+            timer.finish(asgard::Phase::parse);
+            if (!parsed) {
+                LOG_ERROR("receive invalid protobuf");
+                auto* error = response->mutable_error();
+                error->set_id(pbnavitia::Error::invalid_protobuf_request);
+                error->set_message("receive invalid protobuf");
+            } else if (context.matrix_stream_size > 0 && asks_for_stream(job.envelope)) {
+                handler.handle(*pb_req, *response, [&](const pbnavitia::Response& chunk) {
+                    auto envelope = copy_envelope(job.envelope);
+                    respond(socket, envelope, chunk, context.metrics);
+                });
+            } else {
+                handler.handle(*pb_req, *response);
+            }
+
+            respond(socket, job.envelope, *response, context.metrics);
         }
+        context.metrics.observe_request_allocations(asgard::allocation_counter::get_nb_allocations() - nb_allocations,
+                                                     arena.SpaceUsed());
+        arena.Reset();
+    }
+}
 
-        zmq::message_t request;
-        socket.recv(&request);
-        asgard::InFlightGuard in_flight_guard(context.metrics.start_in_flight());
-        pbnavitia::Request pb_req;
-        if (!pb_req.ParseFromArray(request.data(), request.size())) {
-            LOG_ERROR("receive invalid protobuf");
-            pbnavitia::Response response;
-            auto* error = response.mutable_error();
-            error->set_id(pbnavitia::Error::invalid_protobuf_request);
-            error->set_message("receive invalid protobuf");
-            respond(socket, address, response);
-            continue;
+// Receive all the frames of a message, the last one is the request and the others its envelope
+static Job receive_job(zmq::socket_t& socket) {
+    Job job;
+    while (true) {
+        zmq::message_t frame;
+        socket.recv(&frame);
+        if (!frame.more()) {
+            job.request = std::move(frame);
+            return job;
         }
+        job.envelope.push_back(std::move(frame));
+    }
+}
 
-        const auto response = handler.handle(pb_req);
+// Forward all the frames of a message from a socket to another
+static void forward(zmq::socket_t& from, zmq::socket_t& to) {
+    while (true) {
+        zmq::message_t frame;
+        from.recv(&frame);
+        const bool more = frame.more();
+        to.send(frame, more ? ZMQ_SNDMORE : 0);
+        if (!more) {
+            return;
+        }
+    }
+}
 
-        respond(socket, address, response);
+// The main thread is the only one to use the client socket: it queues the
+// requests and sends back the responses of the workers. While the queue is
+// full, it stops reading requests, so they wait in zmq's buffers.
+static void serve(zmq::socket_t& clients, zmq::socket_t& responses, JobQueue& jobs) {
+    while (!stop_requested) {
+        const bool accept_jobs = !jobs.full();
+        zmq::pollitem_t items[] = {
+            {static_cast<void*>(responses), 0, ZMQ_POLLIN, 0},
+            {static_cast<void*>(clients), 0, ZMQ_POLLIN, 0}};
+        // When the queue is full, we poll regularly to know when a worker has taken a job
+        zmq::poll(items, accept_jobs ? 2 : 1, accept_jobs ? -1 : 10);
+
+        if (items[0].revents & ZMQ_POLLIN) {
+            forward(responses, clients);
+        }
+        if (accept_jobs && (items[1].revents & ZMQ_POLLIN)) {
+            auto job = receive_job(clients);
+            jobs.try_push(job);
+        }
     }
 }
 
@@ -88,29 +304,115 @@ int main() {
 
     boost::thread_group threads;
     zmq::context_t context(1);
-    LoadBalancer lb(context);
-    lb.bind(asgard_conf.socket_path, "inproc://workers");
+    zmq::socket_t clients(context, ZMQ_ROUTER);
+    clients.bind(asgard_conf.socket_path);
+    zmq::socket_t responses(context, ZMQ_DEALER);
+    responses.bind(RESPONSES_SOCKET);
+    JobQueue jobs(asgard_conf.queue_size);
+
     const asgard::Metrics metrics(asgard_conf);
-    const asgard::Projector projector(asgard_conf.cache_size,
-                                      asgard_conf.reachability,
-                                      asgard_conf.radius);
+    asgard::ThreadPool thread_pool(asgard_conf.nb_matrix_threads);
+    asgard::ProjectorOptions projector_options;
+    projector_options.cache_size = asgard_conf.cache_size;
+    projector_options.min_outbound_reach = asgard_conf.reachability;
+    projector_options.min_inbound_reach = asgard_conf.reachability;
+    projector_options.radius = asgard_conf.radius;
+    projector_options.nb_shards = asgard_conf.cache_shards;
+    projector_options.grid_cell_size = asgard_conf.cache_grid_size;
+    projector_options.negative_cache_size = asgard_conf.negative_cache_size;
+    projector_options.negative_cache_ttl = asgard_conf.negative_cache_ttl;
+    projector_options.cache_bytes = asgard_conf.cache_bytes;
+    projector_options.cache_admission = asgard_conf.cache_admission;
+    projector_options.search_pool = &thread_pool;
+    projector_options.search_chunk_size = asgard_conf.projection_chunk_size;
+    const asgard::Projector projector(projector_options);
     valhalla::baldr::GraphReader graph(asgard_conf.valhalla_conf.get_child("mjolnir"));
+    asgard::MatrixCache matrix_cache(asgard_conf.matrix_cache_size, asgard_conf.cache_shards);
 
+    const auto& snapshot_path = asgard_conf.cache_snapshot_path;
+    const auto tileset_version = snapshot_path.empty() ? std::string() : asgard::projector_snapshot::get_tileset_version(graph);
+    if (!snapshot_path.empty()) {
+        const auto start = boost::posix_time::microsec_clock::universal_time();
+        const auto nb_entries = asgard::projector_snapshot::load(projector, snapshot_path, tileset_version);
+        const auto duration = boost::posix_time::microsec_clock::universal_time() - start;
+        LOG_INFO("Projector snapshot: " + std::to_string(nb_entries) + " entries restored in " +
+                 std::to_string(duration.total_milliseconds()) + "ms");
+
+        if (asgard_conf.cache_snapshot_interval > 0) {
+            threads.create_thread([&]() {
+                while (true) {
+                    boost::this_thread::sleep_for(boost::chrono::seconds(asgard_conf.cache_snapshot_interval));
+                    save_projector_cache(projector, snapshot_path, tileset_version, graph);
+                }
+            });
+        }
+    }
+
+    asgard::ProjectionTileProfile tile_profile;
+    const auto& tile_profile_path = asgard_conf.tile_profile_path;
+    if (!tile_profile_path.empty()) {
+        tile_profile.load(tile_profile_path);
+        threads.create_thread(std::bind(&warmup_hottest_tiles, tile_profile.get_hottest_tiles(), std::ref(graph),
+                                        asgard_conf.tile_cache_budget, std::cref(metrics)));
+        if (asgard_conf.tile_profile_interval > 0) {
+            threads.create_thread([&]() {
+                while (true) {
+                    boost::this_thread::sleep_for(boost::chrono::seconds(asgard_conf.tile_profile_interval));
+                    save_tile_profile(tile_profile, tile_profile_path);
+                }
+            });
+        }
+    }
+
+    // the snapshot and the profile are saved on exit, SIGINT and SIGTERM stop the serving loop
+    if (!snapshot_path.empty() || !tile_profile_path.empty()) {
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+    }
+
+    std::unique_ptr<asgard::RequestRecorder> recorder;
+    if (!asgard_conf.capture_path.empty()) {
+        recorder = std::make_unique<asgard::RequestRecorder>(asgard_conf.capture_path, asgard_conf.capture_sampling);
+    }
+
+    // Requests are served during the pre-projection, it only warms the cache up
+    if (asgard_conf.stop_list_path.empty()) {
+        metrics.set_ready(true);
+    } else {
+        threads.create_thread([&]() { preproject_stops(asgard_conf, projector, graph, metrics); });
+    }
+
+    asgard::ContextOptions context_options;
+    context_options.thread_pool = &thread_pool;
+    context_options.matrix_chunk_size = asgard_conf.matrix_chunk_size;
+    context_options.matrix_crow_fly_filter = asgard_conf.matrix_crow_fly_filter;
+    context_options.matrix_batch_size = asgard_conf.matrix_batch_size;
+    context_options.matrix_stream_size = asgard_conf.matrix_stream_size;
+    context_options.matrix_cache = asgard_conf.matrix_cache_size > 0 ? &matrix_cache : nullptr;
+    context_options.tile_profile = tile_profile_path.empty() ? nullptr : &tile_profile;
+    context_options.costing_cache_size = asgard::default_costing_cache_size;
     for (size_t i = 0; i < asgard_conf.nb_threads; ++i) {
-        threads.create_thread(std::bind(&worker, asgard::Context(context,
-                                                                 graph,
-                                                                 metrics,
-                                                                 projector)));
+        threads.create_thread(std::bind(&worker, asgard::Context(context, graph, metrics, projector, context_options),
+                                        std::ref(jobs),
+                                        asgard_conf.arena_size,
+                                        recorder.get()));
     }
 
-    // Connect worker threads to client threads via a queue
-    while (true) {
+    while (!stop_requested) {
         try {
-            lb.run();
+            serve(clients, responses, jobs);
         } catch (const navitia::recoverable_exception& e) {
             LOG_ERROR(e.what());
         } catch (const zmq::error_t&) {} //lors d'un SIGHUP on restore la queue
     }
 
-    return 0;
+    if (!snapshot_path.empty()) {
+        save_projector_cache(projector, snapshot_path, tileset_version, graph);
+    }
+    if (!tile_profile_path.empty()) {
+        save_tile_profile(tile_profile, tile_profile_path);
+    }
+    // the workers are still blocked on the queue and own their sockets:
+    // destroying the zmq context would wait for them forever
+    std::quick_exit(EXIT_SUCCESS);
 }
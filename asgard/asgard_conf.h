@@ -37,7 +37,32 @@ namespace ptree = boost::property_tree;
 struct AsgardConf {
     std::string socket_path;
     std::size_t cache_size;
+    std::size_t cache_bytes;
+    bool cache_admission;
+    std::size_t cache_shards;
+    double cache_grid_size;
+    std::size_t negative_cache_size;
+    unsigned int negative_cache_ttl;
+    std::size_t matrix_cache_size;
     std::size_t nb_threads;
+    std::size_t queue_size;
+    std::size_t arena_size;
+    std::size_t nb_matrix_threads;
+    std::size_t matrix_chunk_size;
+    std::size_t projection_chunk_size;
+    bool matrix_crow_fly_filter;
+    std::size_t matrix_batch_size;
+    std::size_t matrix_stream_size;
+    std::string cache_snapshot_path;
+    std::size_t cache_snapshot_interval;
+    std::string stop_list_path;
+    std::string preprojection_modes;
+    std::size_t nb_preprojection_threads;
+    std::string capture_path;
+    double capture_sampling;
+    std::string tile_profile_path;
+    std::size_t tile_profile_interval;
+    std::size_t tile_cache_budget;
     ptree::ptree valhalla_conf;
     boost::optional<std::string> metrics_binding;
     unsigned int reachability;
@@ -47,7 +72,45 @@ struct AsgardConf {
         configure_logs("ASGARD_LOGGING_FILE_PATH");
         socket_path = get_config<std::string>("ASGARD_SOCKET_PATH", "tcp://*:6000");
         cache_size = get_config<size_t>("ASGARD_CACHE_SIZE", 1000000);
+        // approximate memory budget of the projector's cache in bytes, 0 to only bound its number of entries
+        cache_bytes = get_config<size_t>("ASGARD_CACHE_BYTES", 0);
+        // 1 so that a full cache only admits the places looked up more often than the ones they would evict
+        cache_admission = get_config<bool>("ASGARD_CACHE_ADMISSION", false);
+        cache_shards = get_config<size_t>("ASGARD_CACHE_SHARDS", 16);
+        // in meters, places closer than this share their projection in the cache. 0 to use the exact coordinates
+        cache_grid_size = get_config<double>("ASGARD_CACHE_GRID_SIZE", 0);
+        // failed projections kept to not search them again before the ttl in seconds, 0 (the default) to disable it
+        negative_cache_size = get_config<size_t>("ASGARD_NEGATIVE_CACHE_SIZE", 0);
+        negative_cache_ttl = get_config<unsigned int>("ASGARD_NEGATIVE_CACHE_TTL", 600);
+        matrix_cache_size = get_config<size_t>("ASGARD_MATRIX_CACHE_SIZE", 0);
         nb_threads = get_config<size_t>("ASGARD_NB_THREADS", 3);
+        queue_size = get_config<size_t>("ASGARD_QUEUE_SIZE", 100);
+        arena_size = get_config<size_t>("ASGARD_ARENA_SIZE", 4 * 1024 * 1024);
+        nb_matrix_threads = get_config<size_t>("ASGARD_NB_MATRIX_THREADS", 0);
+        matrix_chunk_size = get_config<size_t>("ASGARD_MATRIX_CHUNK_SIZE", 500);
+        // beyond this number of cache misses, they are searched by chunks in parallel on the matrix threads. 0 to disable it
+        projection_chunk_size = get_config<size_t>("ASGARD_PROJECTION_CHUNK_SIZE", 200);
+        // 1 to not route the locations of the matrices obviously out of reach
+        matrix_crow_fly_filter = get_config<bool>("ASGARD_MATRIX_CROW_FLY_FILTER", false);
+        // bigger matrices are projected by batches of this size to bound their memory, 0 (the default) to disable it
+        matrix_batch_size = get_config<size_t>("ASGARD_MATRIX_BATCH_SIZE", 0);
+        // the cells of a matrix whose client sends a "stream" frame before the request are sent as several
+        // responses of this number of cells, it reads them until it has all the cells or an error. 0 to never stream
+        matrix_stream_size = get_config<size_t>("ASGARD_MATRIX_STREAM_SIZE", 1000);
+        // an empty path disables the snapshot, an interval of 0 only saves it on exit
+        cache_snapshot_path = get_config<std::string>("ASGARD_CACHE_SNAPSHOT_PATH", "");
+        cache_snapshot_interval = get_config<size_t>("ASGARD_CACHE_SNAPSHOT_INTERVAL", 0);
+        // coordinates projected at startup, one per line, for each mode of the comma separated list
+        stop_list_path = get_config<std::string>("ASGARD_STOP_LIST_PATH", "");
+        preprojection_modes = get_config<std::string>("ASGARD_PREPROJECTION_MODES", "walking,bike,car,taxi");
+        // 0 uses all the cores
+        nb_preprojection_threads = get_config<size_t>("ASGARD_NB_PREPROJECTION_THREADS", 0);
+        // the requests are recorded for asgard_replay when a path is given, with the given probability
+        capture_path = get_config<std::string>("ASGARD_CAPTURE_PATH", "");
+        capture_sampling = get_config<double>("ASGARD_CAPTURE_SAMPLING", 0.01);
+        // the tiles where the locations are projected are counted and saved there, and the hottest ones are loaded at startup
+        tile_profile_path = get_config<std::string>("ASGARD_TILE_PROFILE_PATH", "");
+        tile_profile_interval = get_config<size_t>("ASGARD_TILE_PROFILE_INTERVAL", 600);
         metrics_binding = get_config<std::string>("ASGARD_METRICS_BINDING", std::string("0.0.0.0:8080"));
 
         auto valhalla_conf_json = get_config<std::string>("ASGARD_VALHALLA_CONF", "/data/valhalla/valhalla.json");
@@ -55,6 +118,8 @@ struct AsgardConf {
 
         reachability = valhalla_conf.get<unsigned int>("loki.service_defaults.minimum_reachability", 0);
         radius = valhalla_conf.get<unsigned int>("loki.service_defaults.radius", 0);
+        // same default as valhalla's GraphReader
+        tile_cache_budget = valhalla_conf.get<size_t>("mjolnir.max_cache_size", 1000000000);
     }
 };
 
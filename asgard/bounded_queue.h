@@ -0,0 +1,73 @@
+// Copyright 2017-2018, CanalTP and/or its affiliates. All rights reserved.
+//
+// LICENCE: This program is free software; you can redistribute it
+// and/or modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with this program. If not, see
+// <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace asgard {
+
+// Multi-producer multi-consumer queue with a maximal size.
+// Producers never block: they are expected to stop producing while the queue is full.
+template<typename T>
+class BoundedQueue : boost::noncopyable {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    // Return false, and leave value untouched, when the queue is full
+    bool try_push(T& value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= capacity) {
+                return false;
+            }
+            queue.push_back(std::move(value));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // Block until an element is available
+    T pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return !queue.empty(); });
+        T value = std::move(queue.front());
+        queue.pop_front();
+        return value;
+    }
+
+    bool full() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size() >= capacity;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> queue;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+};
+
+} // namespace asgard
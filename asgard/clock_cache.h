@@ -0,0 +1,294 @@
+#pragma once
+
+#include "asgard/frequency_sketch.h"
+
+#include <boost/core/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+namespace asgard {
+
+// The bytes a value allocates besides its own size, none by default
+template<typename Value>
+struct NoHeapSize {
+    size_t operator()(const Value&) const { return 0; }
+};
+
+// Thread safe cache with a bounded number of entries, and optionally a bounded number of bytes.
+//
+// The keys are spread over independent shards, each protected by its own lock.
+// Each shard is a CLOCK cache, an approximation of LRU: a hit only takes the
+// shared lock and sets the reference bit of the entry, so readers never wait for each other.
+//
+// The index of a shard is a flat open addressing table of entry positions, so that
+// neither a lookup nor an insertion allocates once the shard is full.
+//
+// With the frequency admission, a full shard only admits a new key when it has been looked up
+// more often than the entry the CLOCK hand would evict, so a burst of keys seen once
+// doesn't flush the popular ones.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename HeapSize = NoHeapSize<Value>>
+class ClockCache : boost::noncopyable {
+private:
+    // The reference bit is the only thing a cache hit touches
+    struct Entry {
+        Key key;
+        Value value;
+        std::atomic<bool> referenced;
+
+        Entry(const Key& key, const Value& value) : key(key), value(value), referenced(false) {}
+    };
+
+    // Position of an entry plus one in the slots of the index, 0 for an empty slot
+    using Slot = uint32_t;
+
+    // A deque is used since it never moves the entries when growing
+    struct Shard {
+        mutable std::shared_timed_mutex mutex;
+        // linear probing, with a size power of 2 and a load factor kept under 1/2
+        std::vector<Slot> slots;
+        std::deque<Entry> entries;
+        size_t capacity = 0;
+        size_t max_bytes = std::numeric_limits<size_t>::max();
+        size_t hand = 0;
+        size_t bytes = 0;
+        // null without the frequency admission
+        std::unique_ptr<FrequencySketch> sketch;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> nb_rejected{0};
+
+    Shard& get_shard(const Key& key) const {
+        // the low bits are used by the slots of the shard's index, so we pick the shard with the high ones
+        const auto h = Hash{}(key);
+        return *shards[(h >> (sizeof(size_t) * 4)) % shards.size()];
+    }
+
+    // Return the slot holding key, or the empty slot where it would be inserted
+    static size_t find_slot(const Shard& shard, const Key& key) {
+        const auto mask = shard.slots.size() - 1;
+        for (auto i = Hash{}(key) & mask;; i = (i + 1) & mask) {
+            const auto slot = shard.slots[i];
+            if (slot == 0 || shard.entries[slot - 1].key == key) {
+                return i;
+            }
+        }
+    }
+
+    // Backward shift deletion: the following entries of the cluster are moved back
+    // when their probe sequence goes through the freed slot, so no tombstone is needed
+    static void erase_slot(Shard& shard, size_t i) {
+        const auto mask = shard.slots.size() - 1;
+        shard.slots[i] = 0;
+        for (auto j = (i + 1) & mask; shard.slots[j] != 0; j = (j + 1) & mask) {
+            const auto ideal = Hash{}(shard.entries[shard.slots[j] - 1].key) & mask;
+            // the entry stays if its ideal slot is cyclically in ]i, j]
+            const bool stays = i <= j ? (i < ideal && ideal <= j) : (i < ideal || ideal <= j);
+            if (!stays) {
+                shard.slots[i] = shard.slots[j];
+                shard.slots[j] = 0;
+                i = j;
+            }
+        }
+    }
+
+    // Approximate bytes held by an entry, counting the slots of the index at their maximal load
+    static size_t get_entry_bytes(const Value& value) {
+        return sizeof(Entry) + 2 * sizeof(Slot) + HeapSize{}(value);
+    }
+
+    // CLOCK: give a second chance to every entry referenced since the last sweep
+    static size_t advance_hand(Shard& shard) {
+        while (shard.entries[shard.hand].referenced.load(std::memory_order_relaxed)) {
+            shard.entries[shard.hand].referenced.store(false, std::memory_order_relaxed);
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+        return shard.hand;
+    }
+
+    // The last entry takes the place of the removed one, so the entries stay contiguous
+    static void remove_entry(Shard& shard, size_t position) {
+        const auto last = shard.entries.size() - 1;
+        if (position != last) {
+            auto& moved = shard.entries[last];
+            shard.slots[find_slot(shard, moved.key)] = static_cast<Slot>(position + 1);
+            auto& entry = shard.entries[position];
+            entry.key = std::move(moved.key);
+            entry.value = std::move(moved.value);
+            entry.referenced.store(moved.referenced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        shard.entries.pop_back();
+        if (shard.hand >= shard.entries.size()) {
+            shard.hand = 0;
+        }
+    }
+
+    // The table grows with the entries, up to twice the capacity of the shard
+    static void reserve_slots(Shard& shard, size_t nb_entries) {
+        if (nb_entries * 2 <= shard.slots.size()) {
+            return;
+        }
+        size_t nb_slots = std::max<size_t>(16, shard.slots.size() * 2);
+        while (nb_entries * 2 > nb_slots) {
+            nb_slots *= 2;
+        }
+        shard.slots.assign(nb_slots, 0);
+        for (size_t e = 0; e < shard.entries.size(); ++e) {
+            shard.slots[find_slot(shard, shard.entries[e].key)] = static_cast<Slot>(e + 1);
+        }
+    }
+
+public:
+    // The number of shards is lowered so that each shard holds at least min_shard_capacity entries.
+    // max_bytes bounds the bytes of the entries as given by get_memory_usage, 0 for no bound
+    ClockCache(size_t capacity,
+               size_t nb_shards,
+               size_t min_shard_capacity = 64,
+               size_t max_bytes = 0,
+               bool frequency_admission = false) {
+        nb_shards = std::max<size_t>(1, std::min(nb_shards, capacity / std::max<size_t>(1, min_shard_capacity)));
+        for (size_t i = 0; i < nb_shards; ++i) {
+            shards.push_back(std::make_unique<Shard>());
+            // spread the remainder so the total capacity is exactly the given one
+            shards.back()->capacity = capacity / nb_shards + (i < capacity % nb_shards ? 1 : 0);
+            if (max_bytes > 0) {
+                shards.back()->max_bytes = max_bytes / nb_shards + (i < max_bytes % nb_shards ? 1 : 0);
+            }
+            if (frequency_admission && shards.back()->capacity > 0) {
+                shards.back()->sketch = std::make_unique<FrequencySketch>(shards.back()->capacity);
+            }
+        }
+    }
+
+    // Call on_hit with the cached value, under the shared lock of its shard.
+    // Return false when the key is not cached
+    template<typename F>
+    bool find(const Key& key, F&& on_hit) const {
+        auto& shard = get_shard(key);
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        if (shard.sketch) {
+            // hits and misses alike, the misses being the candidates of the admission
+            shard.sketch->increment(Hash{}(key));
+        }
+        if (shard.slots.empty()) {
+            return false;
+        }
+        const auto slot = shard.slots[find_slot(shard, key)];
+        if (slot == 0) {
+            return false;
+        }
+        auto& entry = shard.entries[slot - 1];
+        // Only write the reference bit when needed, to keep the cache line shared between readers
+        if (!entry.referenced.load(std::memory_order_relaxed)) {
+            entry.referenced.store(true, std::memory_order_relaxed);
+        }
+        on_hit(entry.value);
+        return true;
+    }
+
+    void insert(const Key& key, const Value& value) {
+        auto& shard = get_shard(key);
+        const auto bytes = get_entry_bytes(value);
+        if (shard.capacity == 0 || bytes > shard.max_bytes) {
+            return;
+        }
+        std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+        if (shard.sketch && shard.sketch->should_age()) {
+            shard.sketch->age();
+        }
+        reserve_slots(shard, std::min(shard.entries.size() + 1, shard.capacity));
+        const auto i = find_slot(shard, key);
+        if (shard.slots[i] != 0) {
+            // Another thread inserted the same key in the meantime
+            auto& entry = shard.entries[shard.slots[i] - 1];
+            shard.bytes = shard.bytes + bytes - get_entry_bytes(entry.value);
+            entry.value = value;
+            return;
+        }
+        // A large value may need to evict several entries to fit in the bytes of the shard
+        bool admitted = !shard.sketch;
+        while (!shard.entries.empty() &&
+               (shard.entries.size() >= shard.capacity || shard.bytes + bytes > shard.max_bytes)) {
+            const auto position = advance_hand(shard);
+            auto& victim = shard.entries[position];
+            if (!admitted) {
+                if (shard.sketch->estimate(Hash{}(key)) <= shard.sketch->estimate(Hash{}(victim.key))) {
+                    ++nb_rejected;
+                    return;
+                }
+                admitted = true;
+            }
+            erase_slot(shard, find_slot(shard, victim.key));
+            shard.bytes -= get_entry_bytes(victim.value);
+            if (shard.bytes + bytes <= shard.max_bytes) {
+                // Replaced in place, so a full cache doesn't allocate
+                victim.key = key;
+                victim.value = value;
+                shard.bytes += bytes;
+                shard.slots[find_slot(shard, key)] = static_cast<Slot>(position + 1);
+                shard.hand = (position + 1) % shard.entries.size();
+                return;
+            }
+            remove_entry(shard, position);
+        }
+        shard.slots[find_slot(shard, key)] = static_cast<Slot>(shard.entries.size() + 1);
+        shard.entries.emplace_back(key, value);
+        shard.bytes += bytes;
+    }
+
+    size_t size() const {
+        size_t size = 0;
+        for (const auto& shard : shards) {
+            std::shared_lock<std::shared_timed_mutex> lock(shard->mutex);
+            size += shard->entries.size();
+        }
+        return size;
+    }
+
+    // Approximate bytes used by the entries, their index and what their values allocate
+    size_t get_memory_usage() const {
+        size_t bytes = 0;
+        for (const auto& shard : shards) {
+            std::shared_lock<std::shared_timed_mutex> lock(shard->mutex);
+            bytes += shard->bytes;
+        }
+        return bytes;
+    }
+
+    size_t get_nb_shards() const { return shards.size(); }
+
+    // Number of new keys not admitted since they were less popular than their victim
+    size_t get_nb_rejected() const { return nb_rejected; }
+
+    // Call f(key, value) on every entry, shard by shard. The entries of a shard are copied under its
+    // shared lock and f is called once it is released, so only one shard is copied at a time
+    template<typename F>
+    void for_each(F&& f) const {
+        std::vector<std::pair<Key, Value>> copies;
+        for (const auto& shard : shards) {
+            copies.clear();
+            {
+                std::shared_lock<std::shared_timed_mutex> lock(shard->mutex);
+                copies.reserve(shard->entries.size());
+                for (const auto& entry : shard->entries) {
+                    copies.emplace_back(entry.key, entry.value);
+                }
+            }
+            for (const auto& copy : copies) {
+                f(copy.first, copy.second);
+            }
+        }
+    }
+};
+
+} // namespace asgard
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "asgard/matrix_cache.h"
+
 #include <valhalla/baldr/graphreader.h>
 
 #include <boost/property_tree/ptree.hpp>
@@ -28,18 +30,46 @@ namespace asgard {
 
 class Metrics;
 class Projector;
+class ThreadPool;
+class ProjectionTileProfile;
+
+// What the workers share besides the graph, the metrics and the projector. Everything is off by default
+struct ContextOptions {
+    // Helper threads shared by the workers, nullptr when a request is always computed on its worker
+    ThreadPool* thread_pool = nullptr;
+    // Matrices with a side larger than this size are split into chunks of this size: the side valhalla searches from
+    // when it is larger, otherwise the other side, along a Z-order curve. 0 to disable it
+    size_t matrix_chunk_size = 0;
+    // Locations too far as the crow flies to be reached within max_duration are not routed
+    bool matrix_crow_fly_filter = false;
+    // Matrices whose biggest side is larger than this size are projected by batches of this size,
+    // to bound their memory. They are still routed at once, unless streamed. 0 to disable it
+    size_t matrix_batch_size = 0;
+    // The matrices whose client asks for it are routed and sent by chunks of this number of cells.
+    // 0 to always send them in a single response
+    size_t matrix_stream_size = 0;
+    // Cells of matrix already computed, shared by the workers. nullptr to disable it
+    MatrixCache* matrix_cache = nullptr;
+    // Counts the tiles the requests project their locations in. nullptr to disable it
+    ProjectionTileProfile* tile_profile = nullptr;
+    // Sets of arguments whose costings each worker keeps for the next requests, the costings are never
+    // shared between workers. 0 to build them for each request
+    size_t costing_cache_size = 0;
+};
 
-struct Context {
+struct Context : ContextOptions {
     zmq::context_t& zmq_context;
     valhalla::baldr::GraphReader& graph;
     const Metrics& metrics;
     const Projector& projector;
 
     Context(zmq::context_t& zmq_context, valhalla::baldr::GraphReader& graph,
-            const Metrics& metrics, const Projector& projector) : zmq_context(zmq_context),
-                                                                  graph(graph),
-                                                                  metrics(metrics),
-                                                                  projector(projector) {}
+            const Metrics& metrics, const Projector& projector,
+            const ContextOptions& options = ContextOptions()) : ContextOptions(options),
+                                                                zmq_context(zmq_context),
+                                                                graph(graph),
+                                                                metrics(metrics),
+                                                                projector(projector) {}
 };
 
 } // namespace asgard
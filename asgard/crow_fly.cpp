@@ -0,0 +1,83 @@
+#include "asgard/crow_fly.h"
+
+#include <valhalla/midgard/constants.h>
+
+#include <cmath>
+#include <cstdint>
+
+using namespace valhalla;
+
+namespace asgard {
+
+namespace crow_fly {
+
+namespace {
+
+constexpr double RAD_PER_DEG = M_PI / 180;
+
+// Coordinates of the points on the unit sphere, one array per axis
+struct UnitVectors {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    explicit UnitVectors(const std::vector<midgard::PointLL>& points) {
+        x.reserve(points.size());
+        y.reserve(points.size());
+        z.reserve(points.size());
+        for (const auto& p : points) {
+            const double lng = p.lng() * RAD_PER_DEG;
+            const double lat = p.lat() * RAD_PER_DEG;
+            x.push_back(std::cos(lat) * std::cos(lng));
+            y.push_back(std::cos(lat) * std::sin(lng));
+            z.push_back(std::sin(lat));
+        }
+    }
+};
+
+} // namespace
+
+void mark_out_of_reach(const std::vector<midgard::PointLL>& sources,
+                       const std::vector<midgard::PointLL>& targets,
+                       double max_distance,
+                       std::vector<bool>& sources_out_of_reach,
+                       std::vector<bool>& targets_out_of_reach) {
+    sources_out_of_reach.assign(sources.size(), false);
+    targets_out_of_reach.assign(targets.size(), false);
+
+    // Beyond half the circumference, every point is in reach
+    const double angle = max_distance / midgard::kRadEarthMeters;
+    if (angle >= M_PI) {
+        return;
+    }
+    // Length of the chord between two points at max_distance on the great circle
+    const double max_chord = 2 * std::sin(angle / 2);
+    const double max_squared_chord = max_chord * max_chord;
+
+    const UnitVectors s(sources);
+    const UnitVectors t(targets);
+    const size_t nb_targets = targets.size();
+    std::vector<uint8_t> targets_in_reach(nb_targets, 0);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const double x = s.x[i];
+        const double y = s.y[i];
+        const double z = s.z[i];
+        uint8_t source_in_reach = 0;
+        for (size_t j = 0; j < nb_targets; ++j) {
+            const double dx = x - t.x[j];
+            const double dy = y - t.y[j];
+            const double dz = z - t.z[j];
+            const uint8_t in_reach = dx * dx + dy * dy + dz * dz <= max_squared_chord;
+            targets_in_reach[j] |= in_reach;
+            source_in_reach |= in_reach;
+        }
+        sources_out_of_reach[i] = !source_in_reach;
+    }
+    for (size_t j = 0; j < nb_targets; ++j) {
+        targets_out_of_reach[j] = !targets_in_reach[j];
+    }
+}
+
+} // namespace crow_fly
+
+} // namespace asgard
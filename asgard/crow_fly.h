@@ -0,0 +1,23 @@
+#pragma once
+
+#include <valhalla/midgard/pointll.h>
+
+#include <vector>
+
+namespace asgard {
+
+namespace crow_fly {
+
+// Flag the sources (resp. the targets) farther than max_distance meters, as the crow flies,
+// from every target (resp. every source): no path can link them within this distance.
+// The points are turned into unit vectors so that the inner loop only compares chord lengths
+// and can be vectorized by the compiler, without any trigonometry per pair.
+void mark_out_of_reach(const std::vector<valhalla::midgard::PointLL>& sources,
+                       const std::vector<valhalla::midgard::PointLL>& targets,
+                       double max_distance,
+                       std::vector<bool>& sources_out_of_reach,
+                       std::vector<bool>& targets_out_of_reach);
+
+} // namespace crow_fly
+
+} // namespace asgard
@@ -361,13 +361,21 @@ pbnavitia::Response build_journey_response(const pbnavitia::Request& request,
                                            const TripLeg& trip_leg,
                                            valhalla::Api& api) {
     pbnavitia::Response response;
+    build_journey_response(request, pathedges, trip_leg, api, response);
+    return response;
+}
 
+void build_journey_response(const pbnavitia::Request& request,
+                            const std::vector<valhalla::thor::PathInfo>& pathedges,
+                            const TripLeg& trip_leg,
+                            valhalla::Api& api,
+                            pbnavitia::Response& response) {
     if (pathedges.empty() ||
         api.mutable_trip()->routes_size() == 0 || !api.has_directions() ||
         api.mutable_directions()->mutable_routes(0)->legs_size() == 0) {
         response.set_response_type(pbnavitia::NO_SOLUTION);
         LOG_ERROR("No solution found !");
-        return response;
+        return;
     }
 
     LOG_INFO("Building solution...");
@@ -407,7 +415,6 @@ pbnavitia::Response build_journey_response(const pbnavitia::Request& request,
 
     compute_metadata(*journey);
     LOG_INFO("Solution built...");
-    return response;
 }
 
 void set_extremity_pt_object(const valhalla::midgard::PointLL& geo_point, pbnavitia::PtObject* o) {
@@ -6,6 +6,7 @@
 #include <boost/optional/optional.hpp>
 namespace pbnavitia {
 class Request;
+class StreetNetworkParams;
 } // namespace pbnavitia
 
 namespace valhalla {
@@ -32,6 +33,11 @@ pbnavitia::Response build_journey_response(const pbnavitia::Request& request,
                                            const std::vector<valhalla::thor::PathInfo>& pathedges,
                                            const valhalla::TripLeg& trip_leg,
                                            valhalla::Api& api);
+void build_journey_response(const pbnavitia::Request& request,
+                            const std::vector<valhalla::thor::PathInfo>& pathedges,
+                            const valhalla::TripLeg& trip_leg,
+                            valhalla::Api& api,
+                            pbnavitia::Response& response);
 
 using ConstManeuverItetator = google::protobuf::RepeatedPtrField<valhalla::DirectionsLeg_Maneuver>::const_iterator;
 
@@ -44,6 +50,36 @@ void compute_path_items(valhalla::Api& api,
                         ConstManeuverItetator begin_maneuver,
                         ConstManeuverItetator end_maneuver);
 
+// The sections of a bss journey, see build_bss_journey
+void make_bss_streetnetwork_section(pbnavitia::Journey& journey,
+                                    valhalla::Api& api,
+                                    const valhalla::DirectionsLeg& directions_leg,
+                                    const std::vector<valhalla::midgard::PointLL>& shape,
+                                    ConstManeuverItetator begin_maneuver,
+                                    ConstManeuverItetator end_maneuver,
+                                    const time_t begin_date_time,
+                                    const pbnavitia::StreetNetworkParams& request_params,
+                                    const size_t nb_sections,
+                                    const bool enable_instructions);
+void make_bss_rent_section(pbnavitia::Journey& journey,
+                           valhalla::Api& api,
+                           const valhalla::DirectionsLeg& directions_leg,
+                           const std::vector<valhalla::midgard::PointLL>& shape,
+                           ConstManeuverItetator rent_maneuver,
+                           const time_t begin_date_time,
+                           const pbnavitia::StreetNetworkParams& request_params,
+                           const size_t nb_sections,
+                           const bool enable_instructions);
+void make_bss_return_section(pbnavitia::Journey& journey,
+                             valhalla::Api& api,
+                             const valhalla::DirectionsLeg& directions_leg,
+                             const std::vector<valhalla::midgard::PointLL>& shape,
+                             ConstManeuverItetator return_maneuver,
+                             const time_t begin_date_time,
+                             const pbnavitia::StreetNetworkParams& request_params,
+                             const size_t nb_sections,
+                             const bool enable_instructions);
+
 void set_path_item_name(const valhalla::DirectionsLeg_Maneuver& maneuver, pbnavitia::PathItem& path_item);
 void set_path_item_length(const valhalla::DirectionsLeg_Maneuver& maneuver, pbnavitia::PathItem& path_item);
 void set_path_item_type(const valhalla::TripLeg_Edge& edge, pbnavitia::PathItem& path_item);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace asgard {
+
+// Count-min sketch of how often keys are looked up, used by ClockCache to only admit
+// a new key when it is more popular than the entry it would evict (TinyLFU).
+//
+// Each of the DEPTH rows holds small saturating counters, and the estimation of a key
+// is its smallest counter. All the counters are halved every AGING_PERIOD lookups per
+// counter of a row, so that the keys popular a long time ago fade out.
+//
+// increment and estimate can be called concurrently, the counters being relaxed atomics:
+// a lost increment only makes the estimation a bit lower. age must be called alone.
+class FrequencySketch : boost::noncopyable {
+private:
+    static constexpr size_t DEPTH = 4;
+    static constexpr uint8_t MAX_COUNT = 15;
+    static constexpr size_t AGING_PERIOD = 10;
+
+    size_t width;
+    std::vector<std::atomic<uint8_t>> counters;
+    std::atomic<size_t> nb_samples{0};
+
+    static size_t round_up(size_t width) {
+        size_t power = 16;
+        while (power < width) {
+            power *= 2;
+        }
+        return power;
+    }
+
+    size_t get_index(size_t hash, size_t row) const {
+        static constexpr uint64_t SEEDS[DEPTH] = {0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull,
+                                                  0x9ae16a3b2f90404full, 0xcbf29ce484222325ull};
+        uint64_t h = (static_cast<uint64_t>(hash) ^ SEEDS[row]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+        return row * width + (h & (width - 1));
+    }
+
+public:
+    // width is rounded up to a power of 2, about the number of keys the cache holds
+    explicit FrequencySketch(size_t width) : width(round_up(width)),
+                                             counters(DEPTH * this->width) {}
+
+    void increment(size_t hash) {
+        for (size_t row = 0; row < DEPTH; ++row) {
+            auto& counter = counters[get_index(hash, row)];
+            const auto count = counter.load(std::memory_order_relaxed);
+            if (count < MAX_COUNT) {
+                counter.store(count + 1, std::memory_order_relaxed);
+            }
+        }
+        nb_samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint8_t estimate(size_t hash) const {
+        uint8_t count = MAX_COUNT;
+        for (size_t row = 0; row < DEPTH; ++row) {
+            count = std::min(count, counters[get_index(hash, row)].load(std::memory_order_relaxed));
+        }
+        return count;
+    }
+
+    bool should_age() const {
+        return nb_samples.load(std::memory_order_relaxed) >= AGING_PERIOD * width;
+    }
+
+    void age() {
+        for (auto& counter : counters) {
+            counter.store(counter.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+        nb_samples.store(nb_samples.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+};
+
+} // namespace asgard
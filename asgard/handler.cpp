@@ -17,20 +17,30 @@
 #include "asgard/handler.h"
 #include "utils/coord_parser.h"
 #include "asgard/context.h"
+#include "asgard/crow_fly.h"
 #include "asgard/direct_path_response_builder.h"
 #include "asgard/metrics.h"
+#include "asgard/parallel_search.h"
 #include "asgard/projector.h"
 #include "asgard/request.pb.h"
+#include "asgard/thread_pool.h"
+#include "asgard/tile_profile.h"
 #include "asgard/util.h"
 
 #include <valhalla/midgard/pointll.h>
 #include <valhalla/odin/directionsbuilder.h>
 #include <valhalla/thor/attributes_controller.h>
 #include <valhalla/thor/triplegbuilder.h>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/optional.hpp>
 #include <boost/range/join.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <ctime>
+#include <exception>
+#include <future>
+#include <memory>
 #include <numeric>
 #include <utility>
 
@@ -41,19 +51,22 @@ namespace asgard {
 using ValhallaLocations = google::protobuf::RepeatedPtrField<valhalla::Location>;
 using ProjectedLocations = std::unordered_map<midgard::PointLL, valhalla::baldr::PathLocation>;
 
-// The max size of matrix in jormungandr is 5000 so far...
-constexpr size_t MAX_MASK_SIZE = 10000;
-using ProjectionFailedMask = std::bitset<MAX_MASK_SIZE>;
+// One bit per location of a side of the matrix, set when the location is not routed
+using ProjectionFailedMask = std::vector<bool>;
+
+// The crow fly distance at the top speed of the mode is a lower bound of the duration of a path.
+// The margins cover the paths going faster than the requested speed (downhill bikes, ferries...)
+// and the distance between the locations and their projections
+constexpr float CROW_FLY_SPEED_MARGIN = 1.5;
+constexpr float CROW_FLY_PROJECTION_SLACK = 1000; // meters
 
 namespace {
 
-pbnavitia::Response make_error_response(pbnavitia::Error_error_id err_id, const std::string& err_msg) {
-    pbnavitia::Response error_response;
+void set_error_response(pbnavitia::Response& error_response, pbnavitia::Error_error_id err_id, const std::string& err_msg) {
     error_response.set_response_type(pbnavitia::NO_SOLUTION);
     error_response.mutable_error()->set_id(err_id);
     error_response.mutable_error()->set_message(err_msg);
     LOG_ERROR(err_msg + " No solution found !");
-    return error_response;
 }
 
 float get_distance(const std::string& mode, float duration) {
@@ -67,6 +80,26 @@ float get_distance(const std::string& mode, float duration) {
     return duration * kTimeDistCostThresholdAutoDivisor;
 }
 
+// In m/s, 0 when the request doesn't give it
+float get_top_speed(const ModeCostingArgs& args) {
+    const auto& speeds = args.speeds;
+    if (args.mode == "bss") {
+        return std::max(speeds[valhalla::Costing::pedestrian], speeds[valhalla::Costing::bicycle]);
+    }
+    return speeds[util::convert_navitia_to_valhalla_costing(args.mode)];
+}
+
+std::vector<midgard::PointLL> select_in_reach(const std::vector<midgard::PointLL>& locations, const std::vector<bool>& out_of_reach) {
+    std::vector<midgard::PointLL> result;
+    result.reserve(locations.size());
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (!out_of_reach[i]) {
+            result.push_back(locations[i]);
+        }
+    }
+    return result;
+}
+
 ModeCostingArgs
 make_modecosting_args(const pbnavitia::DirectPathRequest& request) {
     ModeCostingArgs args{};
@@ -120,48 +153,146 @@ make_modecosting_args(const pbnavitia::StreetNetworkRoutingMatrixRequest& reques
 
 std::pair<ValhallaLocations, ProjectionFailedMask>
 make_valhalla_locations_from_projected_locations(const std::vector<midgard::PointLL>& navitia_locations,
+                                                 const std::vector<bool>& out_of_reach,
                                                  const ProjectedLocations& projected_locations,
                                                  valhalla::baldr::GraphReader& graph) {
     ValhallaLocations valhalla_locations;
     // This mask is used to remember the index of navitia locations whose projection has failed
+    // or which are out of reach, as they are not routed either
     // 0 means projection OK, 1 means projection KO
-    ProjectionFailedMask projection_failed_mask;
+    ProjectionFailedMask projection_failed_mask(navitia_locations.size(), false);
 
     size_t source_idx = -1;
     for (const auto& l : navitia_locations) {
         ++source_idx;
+        if (out_of_reach[source_idx]) {
+            projection_failed_mask[source_idx] = true;
+            continue;
+        }
         auto it = projected_locations.find(l);
         if (it == projected_locations.end()) {
-            projection_failed_mask.set(source_idx);
+            projection_failed_mask[source_idx] = true;
             LOG_ERROR("Cannot project coord: " + std::to_string(l.lng()) + ";" + std::to_string(l.lat()));
             continue;
         }
         baldr::PathLocation::toPBF(it->second, valhalla_locations.Add(), graph);
     }
 
-    return std::make_pair(std::move(valhalla_locations), projection_failed_mask);
+    return std::make_pair(std::move(valhalla_locations), std::move(projection_failed_mask));
+}
+
+// The matrix algorithms keep their state between two calls, so each thread
+// computing a chunk of matrix needs its own instance
+template<typename Matrix>
+Matrix& get_thread_local_matrix() {
+    static thread_local Matrix matrix;
+    return matrix;
+}
+
+template<typename Matrix>
+std::vector<thor::TimeDistance> source_to_target(Matrix& matrix,
+                                                 const ValhallaLocations& sources,
+                                                 const ValhallaLocations& targets,
+                                                 valhalla::baldr::GraphReader& graph,
+                                                 const Costing& costing,
+                                                 const sif::TravelMode travel_mode,
+                                                 float max_distance) {
+    auto res = matrix.SourceToTarget(sources, targets, graph, costing, travel_mode, max_distance);
+    matrix.Clear();
+    return res;
+}
+
+ValhallaLocations slice_locations(const ValhallaLocations& locations, int begin, int end) {
+    ValhallaLocations result;
+    result.Reserve(end - begin);
+    for (int i = begin; i < end; ++i) {
+        *result.Add() = locations.Get(i);
+    }
+    return result;
+}
+
+// Locations projected at the same place give the same row (resp. column) of matrix, so only one of them is routed.
+// Fill distinct with the first of each, and return the index in distinct of every location
+std::vector<int> deduplicate_locations(const ValhallaLocations& locations, ValhallaLocations& distinct) {
+    std::vector<int> indexes;
+    indexes.reserve(locations.size());
+    std::unordered_map<uint64_t, std::vector<int>> by_hash;
+    for (const auto& l : locations) {
+        auto& candidates = by_hash[hash_projected_location(l)];
+        const auto same = std::find_if(candidates.begin(), candidates.end(), [&](int i) {
+            return is_same_projection(distinct.Get(i), l);
+        });
+        if (same != candidates.end()) {
+            indexes.push_back(*same);
+            continue;
+        }
+        candidates.push_back(distinct.size());
+        indexes.push_back(distinct.size());
+        *distinct.Add() = l;
+    }
+    return indexes;
+}
+
+// Expand the matrix of the distinct locations to the matrix of all the locations
+std::vector<thor::TimeDistance> scatter_matrix(const std::vector<thor::TimeDistance>& distinct_res,
+                                               const std::vector<int>& source_indexes,
+                                               const std::vector<int>& target_indexes,
+                                               size_t nb_distinct_targets) {
+    std::vector<thor::TimeDistance> res;
+    res.reserve(source_indexes.size() * target_indexes.size());
+    for (const auto s : source_indexes) {
+        for (const auto t : target_indexes) {
+            res.push_back(distinct_res[s * nb_distinct_targets + t]);
+        }
+    }
+    return res;
+}
+
+// The searches start from the tile of the first edge of each location
+void add_tile(const valhalla::Location& location, std::vector<uint64_t>& tiles) {
+    if (location.path_edges_size() > 0) {
+        tiles.push_back(location.path_edges(0).graph_id());
+    }
 }
 
 } // namespace
 
 Handler::Handler(const Context& context) : graph(context.graph),
+                                           mode_costing(context.costing_cache_size),
                                            metrics(context.metrics),
-                                           projector(context.projector) {
+                                           projector(context.projector),
+                                           thread_pool(context.thread_pool),
+                                           matrix_chunk_size(context.matrix_chunk_size),
+                                           matrix_crow_fly_filter(context.matrix_crow_fly_filter),
+                                           matrix_batch_size(context.matrix_batch_size),
+                                           matrix_stream_size(context.matrix_stream_size),
+                                           matrix_cache(context.matrix_cache),
+                                           tile_profile(context.tile_profile) {
 }
 
 pbnavitia::Response Handler::handle(const pbnavitia::Request& request) {
+    pbnavitia::Response response;
+    handle(request, response);
+    return response;
+}
+
+void Handler::handle(const pbnavitia::Request& request, pbnavitia::Response& response) {
+    handle(request, response, MatrixChunkCallback());
+}
+
+void Handler::handle(const pbnavitia::Request& request, pbnavitia::Response& response, const MatrixChunkCallback& on_matrix_chunk) {
     switch (request.requested_api()) {
-    case pbnavitia::street_network_routing_matrix: return handle_matrix(request);
-    case pbnavitia::direct_path: return handle_direct_path(request);
+    case pbnavitia::street_network_routing_matrix: return handle_matrix(request, response, on_matrix_chunk);
+    case pbnavitia::direct_path: return handle_direct_path(request, response);
     default:
         LOG_ERROR("wrong request: aborting");
-        return pbnavitia::Response();
+        return;
     }
 }
 
-namespace pt = boost::posix_time;
-pbnavitia::Response Handler::handle_matrix(const pbnavitia::Request& request) {
-    pt::ptime start = pt::microsec_clock::universal_time();
+void Handler::handle_matrix(const pbnavitia::Request& request, pbnavitia::Response& response, const MatrixChunkCallback& on_matrix_chunk) {
+    const auto start = std::chrono::steady_clock::now();
+    PhaseTimer timer(metrics);
     const std::string mode = request.sn_routing_matrix().mode();
     LOG_INFO("Processing matrix request " +
              std::to_string(request.sn_routing_matrix().origins_size()) + "x" +
@@ -171,104 +302,433 @@ pbnavitia::Response Handler::handle_matrix(const pbnavitia::Request& request) {
     const auto navitia_sources = util::convert_locations_to_pointLL(request.sn_routing_matrix().origins());
     const auto navitia_targets = util::convert_locations_to_pointLL(request.sn_routing_matrix().destinations());
 
-    mode_costing.update_costing(make_modecosting_args(request.sn_routing_matrix()));
+    const auto modecosting_args = make_modecosting_args(request.sn_routing_matrix());
+    mode_costing.update_costing(modecosting_args);
 
     const auto costing = mode_costing.get_costing_for_mode(mode);
 
-    // We use the cache only when there are more than one element in the sources/targets, so the cache will keep only stop_points coord
-    bool use_cache = (navitia_sources.size() > 1);
-
-    const auto projected_sources_locations = projector(begin(navitia_sources), end(navitia_sources), graph, mode, costing, use_cache);
-    if (projected_sources_locations.empty()) {
-        LOG_ERROR("All sources projections failed!");
-        return make_error_response(pbnavitia::Error::no_origin, "origins projection failed!");
+    // The locations out of reach are neither projected nor routed, they are reported unreached
+    const auto max_duration = request.sn_routing_matrix().max_duration();
+    std::vector<bool> sources_out_of_reach(navitia_sources.size(), false);
+    std::vector<bool> targets_out_of_reach(navitia_targets.size(), false);
+    const auto top_speed = get_top_speed(modecosting_args);
+    if (matrix_crow_fly_filter && top_speed > 0) {
+        crow_fly::mark_out_of_reach(navitia_sources,
+                                    navitia_targets,
+                                    top_speed * CROW_FLY_SPEED_MARGIN * max_duration + CROW_FLY_PROJECTION_SLACK,
+                                    sources_out_of_reach,
+                                    targets_out_of_reach);
     }
+    const size_t nb_sources_out_of_reach = std::count(sources_out_of_reach.begin(), sources_out_of_reach.end(), true);
+    const size_t nb_targets_out_of_reach = std::count(targets_out_of_reach.begin(), targets_out_of_reach.end(), true);
+    LOG_INFO(std::to_string(nb_sources_out_of_reach) + " origin(s) and " +
+             std::to_string(nb_targets_out_of_reach) + " target(s) out of reach");
+
+    // in fact jormun don't want a real matrix, only a vector of solution along the biggest side :(
+    // Beyond matrix_batch_size locations, this side is projected by batches, so that only the
+    // projections of one batch are in memory at a time. Unless its cells are streamed, it is routed at once:
+    // valhalla searches from the lone location of the other side, a search per batch would expand it again
+    const bool row_of_targets = (navitia_sources.size() == 1);
+    const auto& row_locations = row_of_targets ? navitia_targets : navitia_sources;
+    const auto& row_out_of_reach = row_of_targets ? targets_out_of_reach : sources_out_of_reach;
+    const auto& other_locations = row_of_targets ? navitia_sources : navitia_targets;
+    const auto& other_out_of_reach = row_of_targets ? sources_out_of_reach : targets_out_of_reach;
+    const bool stream = on_matrix_chunk && matrix_stream_size > 0;
+    const size_t batch_size = matrix_batch_size > 0 ? matrix_batch_size : row_locations.size();
 
-    use_cache = (navitia_targets.size() > 1);
-    const auto projected_targets_locations = projector(begin(navitia_targets), end(navitia_targets), graph, mode, costing, use_cache);
-    if (projected_targets_locations.empty()) {
-        LOG_ERROR("All targets projections failed!");
-        return make_error_response(pbnavitia::Error::no_destination, "destinations projection failed!");
+    // We use the cache only when there are more than one element in the sources/targets, so the cache will keep only stop_points coord
+    const auto project = [&](const std::vector<midgard::PointLL>& locations, const std::vector<bool>& out_of_reach, bool use_cache) {
+        const auto in_reach = select_in_reach(locations, out_of_reach);
+        const auto projected = projector(begin(in_reach), end(in_reach), graph, mode, costing, use_cache);
+        return make_valhalla_locations_from_projected_locations(locations, out_of_reach, projected, graph);
+    };
+    // When a side is entirely out of reach, so is the other one and nothing is projected.
+    // An empty side is a projection failure
+    const auto has_location_in_reach = [](const std::vector<bool>& out_of_reach) {
+        return out_of_reach.empty() || std::find(out_of_reach.begin(), out_of_reach.end(), false) != out_of_reach.end();
+    };
+    const auto set_projection_error = [&](bool on_targets) {
+        if (on_targets) {
+            LOG_ERROR("All targets projections failed!");
+            return set_error_response(response, pbnavitia::Error::no_destination, "destinations projection failed!");
+        }
+        LOG_ERROR("All sources projections failed!");
+        return set_error_response(response, pbnavitia::Error::no_origin, "origins projection failed!");
+    };
+
+    // The other side is projected on a helper while the worker projects the first batch of the row.
+    // Whoever claims it first projects it, so the worker doesn't wait for busy helpers: a helper
+    // starting after the claim of the worker returns at once, without touching the request
+    const auto project_other = [&]() {
+        return project(other_locations, other_out_of_reach, other_locations.size() > 1);
+    };
+    using Projection = decltype(project_other());
+    const auto other_claimed = std::make_shared<std::atomic<bool>>(false);
+    std::future<boost::optional<Projection>> other_projection;
+    if (thread_pool != nullptr && thread_pool->size() > 0) {
+        other_projection = thread_pool->submit([other_claimed, &project_other]() -> boost::optional<Projection> {
+            if (other_claimed->exchange(true)) {
+                return boost::none;
+            }
+            return project_other();
+        });
     }
+    ValhallaLocations other_valhalla_locations;
+    ProjectionFailedMask other_projection_mask;
+    ValhallaLocations distinct_other;
+    std::vector<int> other_indexes;
+    bool other_projected = false;
+    // Return false when every projection of the other side failed
+    const auto wait_for_other_side = [&]() {
+        if (other_projected) {
+            return true;
+        }
+        other_projected = true;
+        std::tie(other_valhalla_locations, other_projection_mask) = other_claimed->exchange(true) ? *other_projection.get()
+                                                                                                  : project_other();
+        if (other_valhalla_locations.empty() && has_location_in_reach(other_out_of_reach)) {
+            return false;
+        }
+        other_indexes = deduplicate_locations(other_valhalla_locations, distinct_other);
+        metrics.observe_matrix_dedup(other_valhalla_locations.size(), distinct_other.size());
+        if (tile_profile != nullptr) {
+            std::vector<uint64_t> tiles;
+            for (const auto& l : other_valhalla_locations) {
+                add_tile(l, tiles);
+            }
+            tile_profile->record(tiles);
+        }
+        return true;
+    };
+
+    size_t nb_row_projection_failed = 0;
+    ValhallaLocations row_valhalla_locations;
+    row_valhalla_locations.Reserve(row_locations.size());
+    ProjectionFailedMask row_projection_mask;
+    row_projection_mask.reserve(row_locations.size());
+    for (size_t batch_begin = 0; batch_begin < row_locations.size(); batch_begin += batch_size) {
+        const auto batch_end = std::min(batch_begin + batch_size, row_locations.size());
+        const std::vector<midgard::PointLL> batch(row_locations.begin() + batch_begin, row_locations.begin() + batch_end);
+        const std::vector<bool> batch_out_of_reach(row_out_of_reach.begin() + batch_begin, row_out_of_reach.begin() + batch_end);
+
+        ValhallaLocations batch_valhalla_locations;
+        ProjectionFailedMask batch_projection_mask;
+        try {
+            std::tie(batch_valhalla_locations, batch_projection_mask) = project(batch, batch_out_of_reach, row_locations.size() > 1);
+        } catch (...) {
+            // a helper projecting the other side references the request
+            if (!other_projected && other_claimed->exchange(true)) {
+                other_projection.wait();
+            }
+            throw;
+        }
+        if (!wait_for_other_side()) {
+            return set_projection_error(!row_of_targets);
+        }
+        nb_row_projection_failed += batch.size() - batch_valhalla_locations.size() -
+                                    std::count(batch_out_of_reach.begin(), batch_out_of_reach.end(), true);
 
-    LOG_INFO("Projecting locations done.");
-
-    ValhallaLocations valhalla_location_sources;
-    ProjectionFailedMask projection_mask_sources;
-    std::tie(valhalla_location_sources, projection_mask_sources) = make_valhalla_locations_from_projected_locations(navitia_sources, projected_sources_locations, graph);
-
-    ValhallaLocations valhalla_location_targets;
-    ProjectionFailedMask projection_mask_targets;
-    std::tie(valhalla_location_targets, projection_mask_targets) = make_valhalla_locations_from_projected_locations(navitia_targets, projected_targets_locations, graph);
-
-    LOG_INFO(std::to_string(projection_mask_sources.count()) + " origin(s) projection failed " +
-             std::to_string(projection_mask_targets.count()) + " target(s) projection failed");
-
-    LOG_INFO("Projection Done");
-    LOG_INFO("Computing matrix...");
+        if (tile_profile != nullptr) {
+            std::vector<uint64_t> tiles;
+            for (const auto& l : batch_valhalla_locations) {
+                add_tile(l, tiles);
+            }
+            tile_profile->record(tiles);
+        }
 
-    std::vector<valhalla::thor::TimeDistance> res;
-    if (mode == "bss") {
-        res = bss_matrix.SourceToTarget(valhalla_location_sources,
-                                        valhalla_location_targets,
-                                        graph,
-                                        mode_costing.get_costing(),
-                                        util::convert_navitia_to_valhalla_mode(mode),
-                                        get_distance(mode, request.sn_routing_matrix().max_duration()));
+        for (auto& l : batch_valhalla_locations) {
+            row_valhalla_locations.Add()->Swap(&l);
+        }
+        row_projection_mask.insert(row_projection_mask.end(), batch_projection_mask.begin(), batch_projection_mask.end());
+    }
 
-    } else {
-        res = matrix.SourceToTarget(valhalla_location_sources,
-                                    valhalla_location_targets,
-                                    graph,
-                                    mode_costing.get_costing(),
-                                    util::convert_navitia_to_valhalla_mode(mode),
-                                    get_distance(mode, request.sn_routing_matrix().max_duration()));
+    if (!wait_for_other_side()) {
+        return set_projection_error(!row_of_targets);
     }
+    if (row_valhalla_locations.empty() && has_location_in_reach(row_out_of_reach)) {
+        return set_projection_error(row_of_targets);
+    }
+    timer.finish(Phase::matrix_projection);
 
-    LOG_INFO("Computing matrix done.");
+    const size_t resp_row_size = row_locations.size();
+    assert(resp_row_size == static_cast<size_t>(std::count(row_projection_mask.begin(), row_projection_mask.end(), true)) +
+                                static_cast<size_t>(row_valhalla_locations.size()));
 
-    pbnavitia::Response response;
+    // When the cells are streamed, the row is routed by chunks of matrix_stream_size cells, one after the other,
+    // and each chunk is sent as soon as it is computed: the search of a chunk stops once its own locations are
+    // settled, so the client gets the first cells before the whole row is routed, and the row never holds more
+    // than a chunk. The phases are then observed for each chunk. Otherwise the whole row is routed at once
+    const size_t stream_chunk_size = stream ? matrix_stream_size : std::max<size_t>(resp_row_size, 1);
     int nb_unreached = 0;
-    //in fact jormun don't want a real matrix, only a vector of solution :(
+    int nb_routed = 0;
+    size_t nb_distinct_row = 0;
     auto* row = response.mutable_sn_routing_matrix()->add_rows();
-    assert(res.size() == valhalla_location_sources.size() * valhalla_location_targets.size());
-
-    const auto& failed_projection_mask = (navitia_sources.size() == 1) ? projection_mask_targets : projection_mask_sources;
-    size_t elt_idx = -1;
-    size_t resp_row_size = navitia_sources.size() == 1 ? navitia_targets.size() : navitia_sources.size();
-    assert(resp_row_size == failed_projection_mask.count() + res.size());
-
-    auto res_it = res.cbegin();
-    while (++elt_idx < resp_row_size) {
-        auto* k = row->add_routing_response();
-        if (failed_projection_mask[elt_idx]) {
-            k->set_duration(-1);
-            k->set_routing_status(pbnavitia::RoutingStatus::unreached);
-            ++nb_unreached;
-        } else if (res_it != res.cend()) {
-            k->set_duration(res_it->time);
-            if (res_it->time == thor::kMaxCost ||
-                res_it->time > uint32_t(request.sn_routing_matrix().max_duration())) {
+    row->mutable_routing_response()->Reserve(std::min(stream_chunk_size, resp_row_size));
+    for (size_t chunk_begin = 0; chunk_begin < resp_row_size; chunk_begin += stream_chunk_size) {
+        const auto chunk_end = std::min(chunk_begin + stream_chunk_size, resp_row_size);
+        const int nb_chunk_routed = std::count(row_projection_mask.begin() + chunk_begin, row_projection_mask.begin() + chunk_end, false);
+        ValhallaLocations sliced_row;
+        if (nb_chunk_routed != row_valhalla_locations.size()) {
+            sliced_row = slice_locations(row_valhalla_locations, nb_routed, nb_routed + nb_chunk_routed);
+        }
+        const auto& chunk_row = nb_chunk_routed != row_valhalla_locations.size() ? sliced_row : row_valhalla_locations;
+        nb_routed += nb_chunk_routed;
+
+        ValhallaLocations distinct_row;
+        const auto row_indexes = deduplicate_locations(chunk_row, distinct_row);
+        nb_distinct_row += distinct_row.size();
+        timer.finish(Phase::matrix_locations);
+
+        const auto& distinct_sources = row_of_targets ? distinct_other : distinct_row;
+        const auto& distinct_targets = row_of_targets ? distinct_row : distinct_other;
+        const bool nothing_to_route = distinct_sources.empty() || distinct_targets.empty();
+        const auto distinct_res = nothing_to_route ? std::vector<thor::TimeDistance>{}
+                                                   : compute_matrix_with_cache(distinct_sources,
+                                                                               distinct_targets,
+                                                                               mode,
+                                                                               get_distance(mode, max_duration),
+                                                                               modecosting_args,
+                                                                               max_duration);
+        const auto res = scatter_matrix(distinct_res,
+                                        row_of_targets ? other_indexes : row_indexes,
+                                        row_of_targets ? row_indexes : other_indexes,
+                                        distinct_targets.size());
+        timer.finish(Phase::matrix_computation);
+        assert(res.size() == other_valhalla_locations.size() * chunk_row.size());
+
+        auto res_it = res.cbegin();
+        for (size_t elt_idx = chunk_begin; elt_idx < chunk_end; ++elt_idx) {
+            auto* k = row->add_routing_response();
+            if (row_projection_mask[elt_idx]) {
+                k->set_duration(-1);
                 k->set_routing_status(pbnavitia::RoutingStatus::unreached);
                 ++nb_unreached;
-            } else {
-                k->set_routing_status(pbnavitia::RoutingStatus::reached);
+            } else if (res_it != res.cend()) {
+                k->set_duration(res_it->time);
+                if (res_it->time == thor::kMaxCost ||
+                    res_it->time > uint32_t(max_duration)) {
+                    k->set_routing_status(pbnavitia::RoutingStatus::unreached);
+                    ++nb_unreached;
+                } else {
+                    k->set_routing_status(pbnavitia::RoutingStatus::reached);
+                }
+                ++res_it;
             }
-            ++res_it;
         }
+        if (chunk_end < resp_row_size) {
+            on_matrix_chunk(response);
+            row->clear_routing_response();
+        }
+        timer.finish(Phase::matrix_response);
     }
+    // Each side is observed once, however many chunks the row is routed in
+    metrics.observe_matrix_dedup(row_valhalla_locations.size(), nb_distinct_row);
+    LOG_INFO(std::to_string(nb_distinct_row) + " distinct location(s) routed along the row");
 
+    LOG_INFO(std::to_string(nb_row_projection_failed) + " projection(s) failed along the row");
     LOG_INFO("Request done with " + std::to_string(nb_unreached) + " unreached");
+    metrics.observe_crow_fly_pruned_cells(row_of_targets ? nb_targets_out_of_reach : nb_sources_out_of_reach);
 
     if (graph.OverCommitted()) { graph.Clear(); }
-    matrix.Clear();
     LOG_INFO("Everything is clear.");
 
-    const auto duration = pt::microsec_clock::universal_time() - start;
-    metrics.observe_handle_matrix(mode, duration.total_milliseconds() / 1000.0);
-    metrics.observe_nb_cache_miss(projector.get_nb_cache_miss(), projector.get_nb_cache_calls());
-    metrics.observe_cache_size(projector.get_current_cache_size());
-    return response;
+    const auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    metrics.observe_handle_matrix(mode, duration.count());
+    metrics.observe_nb_cache_miss(projector.get_nb_cache_miss(), projector.get_nb_cache_calls(), projector.get_nb_cache_rejected());
+    metrics.observe_cache_size(projector.get_current_cache_size(), projector.get_cache_memory_usage());
+    metrics.observe_negative_cache(projector.get_nb_negative_cache_hits(), projector.get_current_negative_cache_size());
+}
+
+std::vector<thor::TimeDistance> Handler::compute_matrix(const ValhallaLocations& sources,
+                                                        const ValhallaLocations& targets,
+                                                        const std::string& mode,
+                                                        float max_distance) {
+    const auto& costing = mode_costing.get_costing();
+    const auto travel_mode = util::convert_navitia_to_valhalla_mode(mode);
+
+    // valhalla runs a search from each location of the smallest side: forward from each source when
+    // there are no more sources than targets, backward from each target otherwise.
+    // When this side is larger than a chunk, it is split, so that the chunks share its searches.
+    // Otherwise, as for the 1xN and Nx1 matrices jormungandr sends, the other side is split along a
+    // Z-order curve: each chunk runs the searches again, but a search stops as soon as the locations
+    // of its chunk, close to each other, are settled, instead of the farthest location of the matrix
+    const bool iterate_sources = sources.size() <= targets.size();
+    const size_t chunk_size = matrix_chunk_size;
+    const bool split_iterated = static_cast<size_t>(iterate_sources ? sources.size() : targets.size()) > chunk_size;
+    const bool split_sources = split_iterated == iterate_sources;
+    const auto& split = split_sources ? sources : targets;
+    const size_t nb_others = split_sources ? targets.size() : sources.size();
+
+    nb_matrix_routed_locations += sources.size() + targets.size();
+    if (thread_pool == nullptr || thread_pool->size() == 0 || chunk_size == 0 || static_cast<size_t>(split.size()) <= chunk_size) {
+        nb_matrix_searches += std::min(sources.size(), targets.size());
+        if (mode == "bss") {
+            return source_to_target(bss_matrix, sources, targets, graph, costing, travel_mode, max_distance);
+        }
+        return source_to_target(matrix, sources, targets, graph, costing, travel_mode, max_distance);
+    }
+
+    // The indexes of the split side, in the order it is cut
+    std::vector<int> order(split.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (!split_iterated) {
+        std::vector<uint64_t> z_orders;
+        z_orders.reserve(split.size());
+        for (const auto& l : split) {
+            z_orders.push_back(get_z_order(midgard::PointLL(l.ll().lng(), l.ll().lat())));
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int lhs, int rhs) { return z_orders[lhs] < z_orders[rhs]; });
+    }
+
+    std::vector<std::vector<int>> chunk_indexes;
+    std::vector<ValhallaLocations> chunks;
+    for (size_t begin = 0; begin < order.size(); begin += chunk_size) {
+        chunk_indexes.emplace_back(order.begin() + begin, order.begin() + std::min(begin + chunk_size, order.size()));
+        chunks.emplace_back();
+        chunks.back().Reserve(chunk_indexes.back().size());
+        for (const auto i : chunk_indexes.back()) {
+            *chunks.back().Add() = split.Get(i);
+        }
+        // a chunk matrix runs a search from each location of its smallest side too
+        nb_matrix_searches += std::min(chunk_indexes.back().size(), nb_others);
+    }
+    LOG_INFO("Computing matrix in " + std::to_string(chunks.size()) + " chunks of " +
+             (split_sources ? "sources" : "targets") + "...");
+
+    const auto compute_chunk = [&](const ValhallaLocations& chunk) {
+        const auto& chunk_sources = split_sources ? chunk : sources;
+        const auto& chunk_targets = split_sources ? targets : chunk;
+        if (mode == "bss") {
+            return source_to_target(get_thread_local_matrix<thor::TimeDistanceBSSMatrix>(),
+                                    chunk_sources, chunk_targets, graph, costing, travel_mode, max_distance);
+        }
+        return source_to_target(get_thread_local_matrix<thor::TimeDistanceMatrix>(),
+                                chunk_sources, chunk_targets, graph, costing, travel_mode, max_distance);
+    };
+
+    std::vector<std::future<std::vector<thor::TimeDistance>>> futures;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        futures.push_back(thread_pool->submit([&compute_chunk, &chunk = chunks[i]]() { return compute_chunk(chunk); }));
+    }
+
+    // The worker computes the first chunk itself instead of waiting for the helpers.
+    // Every future must be waited for, even on error, since they reference the chunks
+    std::vector<std::vector<thor::TimeDistance>> results(chunks.size());
+    std::exception_ptr error;
+    try {
+        results.front() = compute_chunk(chunks.front());
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        try {
+            results[i] = futures[i - 1].get();
+        } catch (...) {
+            if (!error) { error = std::current_exception(); }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Put the cells of the chunks back in the order of the whole matrix, ie. row by row of sources.
+    // A chunk of sources is a matrix of its sources x all the targets, a chunk of targets all the sources x its targets
+    const size_t nb_targets = targets.size();
+    std::vector<thor::TimeDistance> res(sources.size() * nb_targets);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const auto& indexes = chunk_indexes[i];
+        for (size_t c = 0; c < indexes.size(); ++c) {
+            for (size_t o = 0; o < nb_others; ++o) {
+                if (split_sources) {
+                    res[indexes[c] * nb_targets + o] = results[i][c * nb_targets + o];
+                } else {
+                    res[o * nb_targets + indexes[c]] = results[i][o * indexes.size() + c];
+                }
+            }
+        }
+    }
+    return res;
+}
+
+std::vector<thor::TimeDistance> Handler::compute_matrix_with_cache(const ValhallaLocations& sources,
+                                                                   const ValhallaLocations& targets,
+                                                                   const std::string& mode,
+                                                                   float max_distance,
+                                                                   const ModeCostingArgs& costing_args,
+                                                                   uint32_t max_duration) {
+    if (matrix_cache == nullptr) {
+        return compute_matrix(sources, targets, mode, max_distance);
+    }
+
+    const auto make_projections = [](const ValhallaLocations& locations) {
+        std::vector<std::shared_ptr<const Projection>> projections;
+        projections.reserve(locations.size());
+        for (const auto& l : locations) {
+            projections.push_back(std::make_shared<const Projection>(make_projection(l)));
+        }
+        return projections;
+    };
+    const auto source_projections = make_projections(sources);
+    const auto target_projections = make_projections(targets);
+    const auto shared_costing_args = std::make_shared<const ModeCostingArgs>(costing_args);
+    const auto make_key = [&](int s, int t) {
+        return MatrixCellKey{source_projections[s], target_projections[t], shared_costing_args, max_duration};
+    };
+
+    // A source (resp. a target) is computed again as soon as one of its cells is missing.
+    // Since jormungandr only sends 1xN or Nx1 matrices, only the missing cells are computed in practice
+    std::vector<boost::optional<thor::TimeDistance>> cells(sources.size() * targets.size());
+    std::vector<bool> missing_sources(sources.size(), false);
+    std::vector<bool> missing_targets(targets.size(), false);
+    size_t nb_misses = 0;
+    for (int s = 0; s < sources.size(); ++s) {
+        for (int t = 0; t < targets.size(); ++t) {
+            auto& cell = cells[s * targets.size() + t];
+            const auto found = matrix_cache->find(make_key(s, t), [&cell](const thor::TimeDistance& td) { cell = td; });
+            if (!found) {
+                missing_sources[s] = true;
+                missing_targets[t] = true;
+                ++nb_misses;
+            }
+        }
+    }
+    metrics.observe_matrix_cache(cells.size() - nb_misses, nb_misses);
+    LOG_INFO(std::to_string(cells.size() - nb_misses) + " cell(s) found in the matrix cache");
+
+    if (nb_misses != 0) {
+        const auto select = [](const ValhallaLocations& locations, const std::vector<bool>& missing, std::vector<int>& indexes) {
+            ValhallaLocations selected;
+            for (int i = 0; i < locations.size(); ++i) {
+                if (missing[i]) {
+                    *selected.Add() = locations.Get(i);
+                    indexes.push_back(i);
+                }
+            }
+            return selected;
+        };
+        std::vector<int> source_indexes;
+        std::vector<int> target_indexes;
+        const auto missing_res = compute_matrix(select(sources, missing_sources, source_indexes),
+                                                select(targets, missing_targets, target_indexes),
+                                                mode,
+                                                max_distance);
+
+        auto res_it = missing_res.cbegin();
+        for (const auto s : source_indexes) {
+            for (const auto t : target_indexes) {
+                cells[s * targets.size() + t] = *res_it;
+                matrix_cache->insert(make_key(s, t), *res_it);
+                ++res_it;
+            }
+        }
+    }
+
+    std::vector<thor::TimeDistance> res;
+    res.reserve(cells.size());
+    for (const auto& cell : cells) {
+        res.push_back(*cell);
+    }
+    return res;
 }
 
 // TODO: Since there are more and more algorithms appearing and developped over different usages,
@@ -296,8 +756,9 @@ thor::PathAlgorithm& Handler::get_path_algorithm(const valhalla::Location& origi
     return bda;
 }
 
-pbnavitia::Response Handler::handle_direct_path(const pbnavitia::Request& request) {
-    pt::ptime start = pt::microsec_clock::universal_time();
+void Handler::handle_direct_path(const pbnavitia::Request& request, pbnavitia::Response& response) {
+    const auto start = std::chrono::steady_clock::now();
+    PhaseTimer timer(metrics);
     const auto mode = request.direct_path().streetnetwork_params().origin_mode();
     LOG_INFO("Processing direct_path request with mode " + mode);
 
@@ -312,15 +773,22 @@ pbnavitia::Response Handler::handle_direct_path(const pbnavitia::Request& reques
     const bool use_cache = false;
     auto projected_locations = projector(begin(locations), end(locations), graph, mode, costing, use_cache);
     LOG_INFO("Projecting locations done.");
+    timer.finish(Phase::direct_path_projection);
 
     if (projected_locations.size() != 2) {
-        return make_error_response(pbnavitia::Error::no_origin_nor_destination, "Cannot project the given coords!");
+        return set_error_response(response, pbnavitia::Error::no_origin_nor_destination, "Cannot project the given coords!");
     }
 
     valhalla::Location origin;
     valhalla::Location dest;
     baldr::PathLocation::toPBF(projected_locations.at(locations.front()), &origin, graph);
     baldr::PathLocation::toPBF(projected_locations.at(locations.back()), &dest, graph);
+    if (tile_profile != nullptr) {
+        std::vector<uint64_t> tiles;
+        add_tile(origin, tiles);
+        add_tile(dest, tiles);
+        tile_profile->record(tiles);
+    }
 
     auto& algo = get_path_algorithm(origin, dest, mode);
 
@@ -331,13 +799,13 @@ pbnavitia::Response Handler::handle_direct_path(const pbnavitia::Request& reques
                                                  mode_costing.get_costing(),
                                                  util::convert_navitia_to_valhalla_mode(mode));
     LOG_INFO("Computing best path done.");
+    timer.finish(Phase::direct_path_path);
 
     // If no solution was found
     if (path_info_list.empty()) {
-        pbnavitia::Response response;
         response.set_response_type(pbnavitia::NO_SOLUTION);
         LOG_ERROR("No solution found !");
-        return response;
+        return;
     }
 
     // The path algorithms all are allowed to return more than one path now.
@@ -350,19 +818,26 @@ pbnavitia::Response Handler::handle_direct_path(const pbnavitia::Request& reques
     auto* trip_leg = api.mutable_trip()->mutable_routes()->Add()->mutable_legs()->Add();
     thor::TripLegBuilder::Build(options, controller, graph, mode_costing.get_costing(), pathedges.begin(),
                                 pathedges.end(), origin, dest, {}, *trip_leg, {"route"}, nullptr, nullptr);
+    timer.finish(Phase::direct_path_trip_leg);
 
     api.mutable_options()->set_language(request.direct_path().streetnetwork_params().language());
+    // Without instructions, only the maneuvers are built: no narrative, and the
+    // dictionaries of the language are never loaded
+    if (!request.direct_path().streetnetwork_params().enable_instructions()) {
+        api.mutable_options()->set_directions_type(valhalla::DirectionsType::maneuvers);
+    }
     odin::DirectionsBuilder::Build(api);
+    timer.finish(Phase::direct_path_directions);
 
-    const auto response = direct_path_response_builder::build_journey_response(request, pathedges, *trip_leg, api);
+    direct_path_response_builder::build_journey_response(request, pathedges, *trip_leg, api, response);
+    timer.finish(Phase::direct_path_response);
 
     if (graph.OverCommitted()) { graph.Clear(); }
     algo.Clear();
     LOG_INFO("Everything is clear.");
 
-    auto duration = pt::microsec_clock::universal_time() - start;
-    metrics.observe_handle_direct_path(mode, duration.total_milliseconds() / 1000.0);
-    return response;
+    const auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    metrics.observe_handle_direct_path(mode, duration.count());
 }
 
 } // namespace asgard
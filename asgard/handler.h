@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "asgard/matrix_cache.h"
 #include "asgard/mode_costing.h"
 #include "asgard/response.pb.h"
 
@@ -26,6 +27,8 @@
 #include <valhalla/thor/timedistancebssmatrix.h>
 #include <valhalla/thor/timedistancematrix.h>
 
+#include <functional>
+
 namespace pbnavitia {
 class Request;
 }
@@ -35,14 +38,42 @@ namespace asgard {
 struct Context;
 class Metrics;
 class Projector;
+class ThreadPool;
+class ProjectionTileProfile;
 
 struct Handler {
+    friend class UnitTestHandler;
+
+    // Called with the response holding the cells of each chunk of a matrix but the last one.
+    // These cells are removed from the response afterwards, the last ones stay in it
+    using MatrixChunkCallback = std::function<void(const pbnavitia::Response&)>;
+
     explicit Handler(const Context&);
     pbnavitia::Response handle(const pbnavitia::Request&);
+    // Fill the given response, which can be allocated on an arena
+    void handle(const pbnavitia::Request&, pbnavitia::Response&);
+    // Same, but a matrix is computed by chunks of matrix_stream_size cells,
+    // each given to on_matrix_chunk as soon as it is computed
+    void handle(const pbnavitia::Request&, pbnavitia::Response&, const MatrixChunkCallback& on_matrix_chunk);
 
 private:
-    pbnavitia::Response handle_matrix(const pbnavitia::Request&);
-    pbnavitia::Response handle_direct_path(const pbnavitia::Request&);
+    void handle_matrix(const pbnavitia::Request&, pbnavitia::Response&, const MatrixChunkCallback& on_matrix_chunk);
+    void handle_direct_path(const pbnavitia::Request&, pbnavitia::Response&);
+
+    std::vector<valhalla::thor::TimeDistance>
+    compute_matrix(const google::protobuf::RepeatedPtrField<valhalla::Location>& sources,
+                   const google::protobuf::RepeatedPtrField<valhalla::Location>& targets,
+                   const std::string& mode,
+                   float max_distance);
+
+    // Only send to compute_matrix the sources and the targets of the cells missing from the matrix cache
+    std::vector<valhalla::thor::TimeDistance>
+    compute_matrix_with_cache(const google::protobuf::RepeatedPtrField<valhalla::Location>& sources,
+                              const google::protobuf::RepeatedPtrField<valhalla::Location>& targets,
+                              const std::string& mode,
+                              float max_distance,
+                              const ModeCostingArgs& costing_args,
+                              uint32_t max_duration);
 
     valhalla::thor::PathAlgorithm& get_path_algorithm(const valhalla::Location& origin,
                                                       const valhalla::Location& destination,
@@ -58,6 +89,17 @@ private:
     ModeCosting mode_costing;
     const Metrics& metrics;
     const Projector& projector;
+    ThreadPool* thread_pool;
+    size_t matrix_chunk_size;
+    bool matrix_crow_fly_filter;
+    size_t matrix_batch_size;
+    size_t matrix_stream_size;
+    MatrixCache* matrix_cache;
+    ProjectionTileProfile* tile_profile;
+    // Searches run by valhalla for the matrices since the construction, one per location of the side it iterates
+    size_t nb_matrix_searches = 0;
+    // Sources and targets given to valhalla for the matrices since the construction
+    size_t nb_matrix_routed_locations = 0;
 };
 
 } // namespace asgard
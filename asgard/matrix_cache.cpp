@@ -0,0 +1,67 @@
+#include "asgard/matrix_cache.h"
+
+#include <valhalla/proto/tripcommon.pb.h>
+
+#include <boost/functional/hash.hpp>
+
+namespace asgard {
+
+bool operator==(const ProjectedEdge& lhs, const ProjectedEdge& rhs) {
+    return lhs.graph_id == rhs.graph_id && lhs.percent_along == rhs.percent_along &&
+           lhs.begin_node == rhs.begin_node && lhs.end_node == rhs.end_node;
+}
+
+size_t hash_value(const ProjectedEdge& edge) {
+    size_t seed = 0;
+    boost::hash_combine(seed, edge.graph_id);
+    boost::hash_combine(seed, edge.percent_along);
+    boost::hash_combine(seed, edge.begin_node);
+    boost::hash_combine(seed, edge.end_node);
+    return seed;
+}
+
+Projection make_projection(const valhalla::Location& location) {
+    Projection projection;
+    projection.reserve(location.path_edges_size());
+    for (const auto& edge : location.path_edges()) {
+        projection.push_back(ProjectedEdge{edge.graph_id(), edge.percent_along(), edge.begin_node(), edge.end_node()});
+    }
+    return projection;
+}
+
+size_t MatrixCellKeyHasher::operator()(const MatrixCellKey& key) const {
+    size_t seed = 0;
+    boost::hash_range(seed, key.source->begin(), key.source->end());
+    boost::hash_range(seed, key.target->begin(), key.target->end());
+    boost::hash_combine(seed, *key.costing_args);
+    boost::hash_combine(seed, key.max_duration);
+    return seed;
+}
+
+uint64_t hash_projected_location(const valhalla::Location& location) {
+    size_t seed = 0;
+    for (const auto& edge : location.path_edges()) {
+        boost::hash_combine(seed, edge.graph_id());
+        boost::hash_combine(seed, edge.percent_along());
+        boost::hash_combine(seed, edge.begin_node());
+        boost::hash_combine(seed, edge.end_node());
+    }
+    return seed;
+}
+
+bool is_same_projection(const valhalla::Location& lhs, const valhalla::Location& rhs) {
+    if (lhs.path_edges_size() != rhs.path_edges_size()) {
+        return false;
+    }
+    for (int i = 0; i < lhs.path_edges_size(); ++i) {
+        const auto& l = lhs.path_edges(i);
+        const auto& r = rhs.path_edges(i);
+        if (l.graph_id() != r.graph_id() || l.percent_along() != r.percent_along() ||
+            l.begin_node() != r.begin_node() || l.end_node() != r.end_node()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace asgard
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "asgard/clock_cache.h"
+#include "asgard/mode_costing.h"
+
+#include <valhalla/thor/timedistancematrix.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace valhalla {
+class Location;
+}
+
+namespace asgard {
+
+// Where a location is projected on one of its edges
+struct ProjectedEdge {
+    uint64_t graph_id;
+    float percent_along;
+    bool begin_node;
+    bool end_node;
+};
+
+bool operator==(const ProjectedEdge& lhs, const ProjectedEdge& rhs);
+
+size_t hash_value(const ProjectedEdge& edge);
+
+// All the edges a location is projected on
+using Projection = std::vector<ProjectedEdge>;
+
+Projection make_projection(const valhalla::Location& location);
+
+// A cell of matrix is identified by where its source and its target are
+// projected, and by everything that changes the cost between them.
+// The projections and the costing arguments are shared by the cells of a same matrix.
+// They are compared as a whole, the hash only picks the bucket of the key
+struct MatrixCellKey {
+    std::shared_ptr<const Projection> source;
+    std::shared_ptr<const Projection> target;
+    std::shared_ptr<const ModeCostingArgs> costing_args;
+    uint32_t max_duration;
+
+    bool operator==(const MatrixCellKey& other) const {
+        return max_duration == other.max_duration && *source == *other.source &&
+               *target == *other.target && *costing_args == *other.costing_args;
+    }
+};
+
+struct MatrixCellKeyHasher {
+    size_t operator()(const MatrixCellKey& key) const;
+};
+
+using MatrixCache = ClockCache<MatrixCellKey, valhalla::thor::TimeDistance, MatrixCellKeyHasher>;
+
+// Hash of the edges a location is projected on, and of its position along them
+uint64_t hash_projected_location(const valhalla::Location& location);
+
+// Whether both locations are projected on the same edges, at the same positions
+bool is_same_projection(const valhalla::Location& lhs, const valhalla::Location& rhs);
+
+} // namespace asgard
@@ -3,6 +3,8 @@
 #include "asgard/asgard_conf.h"
 #include "asgard/conf.h"
 
+#include <prometheus/counter.h>
+#include <prometheus/counter_builder.h>
 #include <prometheus/exposer.h>
 #include <prometheus/family.h>
 #include <prometheus/gauge.h>
@@ -51,6 +53,15 @@ static prometheus::Histogram::BucketBoundaries create_fixed_duration_buckets() {
     return bucket_boundaries;
 }
 
+static prometheus::Histogram::BucketBoundaries create_exponential_buckets(double start, double factor, size_t count) {
+    auto bucket_boundaries = prometheus::Histogram::BucketBoundaries{};
+    for (size_t i = 0; i < count; ++i) {
+        bucket_boundaries.push_back(start);
+        start *= factor;
+    }
+    return bucket_boundaries;
+}
+
 Metrics::Metrics(const boost::optional<const AsgardConf&>& config) {
     if (config == boost::none) {
         return;
@@ -69,7 +80,21 @@ Metrics::Metrics(const boost::optional<const AsgardConf&>& config) {
         {"version", std::string(config::project_version)},
         {"build_type", std::string(config::asgard_build_type)},
         {"max_cache_size", std::to_string(conf.cache_size)},
+        {"max_cache_bytes", std::to_string(conf.cache_bytes)},
+        {"cache_admission", std::to_string(conf.cache_admission)},
+        {"cache_shards", std::to_string(conf.cache_shards)},
+        {"cache_grid_size", std::to_string(conf.cache_grid_size)},
+        {"negative_cache_size", std::to_string(conf.negative_cache_size)},
+        {"negative_cache_ttl", std::to_string(conf.negative_cache_ttl)},
+        {"max_matrix_cache_size", std::to_string(conf.matrix_cache_size)},
         {"nb_threads", std::to_string(conf.nb_threads)},
+        {"nb_matrix_threads", std::to_string(conf.nb_matrix_threads)},
+        {"matrix_chunk_size", std::to_string(conf.matrix_chunk_size)},
+        {"projection_chunk_size", std::to_string(conf.projection_chunk_size)},
+        {"matrix_crow_fly_filter", std::to_string(conf.matrix_crow_fly_filter)},
+        {"matrix_batch_size", std::to_string(conf.matrix_batch_size)},
+        {"matrix_stream_size", std::to_string(conf.matrix_stream_size)},
+        {"preprojection_modes", conf.preprojection_modes},
         {"reachability", std::to_string(conf.reachability)},
         {"radius", std::to_string(conf.radius)}};
 
@@ -116,11 +141,116 @@ Metrics::Metrics(const boost::optional<const AsgardConf&>& config) {
                                .Register(*registry)
                                .Add({});
 
+    nb_cache_rejected_gauge = &prometheus::BuildGauge()
+                                   .Name("nb_cache_rejected")
+                                   .Help("Nb of projections not admitted in the projector's cache since they were less popular than the ones they would evict, from the start of app")
+                                   .Register(*registry)
+                                   .Add({});
+
     current_cache_size = &prometheus::BuildGauge()
                               .Name("cache_size")
                               .Help("current cache size")
                               .Register(*registry)
                               .Add({});
+
+    current_cache_bytes = &prometheus::BuildGauge()
+                               .Name("cache_bytes")
+                               .Help("approximate memory used by the projector's cache, index included")
+                               .Register(*registry)
+                               .Add({});
+
+    cache_bytes_per_entry = &prometheus::BuildGauge()
+                                 .Name("cache_bytes_per_entry")
+                                 .Help("approximate memory used by an entry of the projector's cache, index included")
+                                 .Register(*registry)
+                                 .Add({});
+
+    nb_negative_cache_hits_gauge = &prometheus::BuildGauge()
+                                        .Name("nb_negative_cache_hits")
+                                        .Help("Nb of places not projected again since their projection failed recently, from the start of app")
+                                        .Register(*registry)
+                                        .Add({});
+
+    current_negative_cache_size = &prometheus::BuildGauge()
+                                       .Name("negative_cache_size")
+                                       .Help("current number of failed projections kept")
+                                       .Register(*registry)
+                                       .Add({});
+
+    allocations_histogram = &prometheus::BuildHistogram()
+                                 .Name("asgard_request_allocations")
+                                 .Help("Nb of heap allocations done by a worker to parse, handle and serialize a request")
+                                 .Register(*registry)
+                                 .Add({}, create_exponential_buckets(10, 4, 10));
+
+    arena_bytes_histogram = &prometheus::BuildHistogram()
+                                 .Name("asgard_request_arena_bytes")
+                                 .Help("Bytes used in the worker's arena by the protobuf request and response")
+                                 .Register(*registry)
+                                 .Add({}, create_exponential_buckets(1024, 4, 10));
+
+    auto& matrix_cache_family = prometheus::BuildCounter()
+                                    .Name("asgard_matrix_cache_cells_total")
+                                    .Help("Nb of matrix cells looked up in the matrix cache")
+                                    .Register(*registry);
+    matrix_cache_hits = &matrix_cache_family.Add({{"result", "hit"}});
+    matrix_cache_misses = &matrix_cache_family.Add({{"result", "miss"}});
+
+    crow_fly_pruned_cells = &prometheus::BuildCounter()
+                                 .Name("asgard_matrix_crow_fly_pruned_cells_total")
+                                 .Help("Nb of matrix cells reported unreached without routing, being too far as the crow flies")
+                                 .Register(*registry)
+                                 .Add({});
+
+    // the ratio of distinct locations is rate(distinct) / rate(input)
+    auto& dedup_family = prometheus::BuildCounter()
+                             .Name("asgard_matrix_dedup_locations_total")
+                             .Help("Nb of projected locations of the matrices, and of distinct projections among them")
+                             .Register(*registry);
+    dedup_input_locations = &dedup_family.Add({{"state", "input"}});
+    dedup_distinct_locations = &dedup_family.Add({{"state", "distinct"}});
+
+    auto& phase_family = prometheus::BuildHistogram()
+                             .Name("asgard_phase_duration_seconds")
+                             .Help("duration of each phase of the requests")
+                             .Register(*registry);
+    const std::array<std::pair<const char*, const char*>, static_cast<size_t>(Phase::count)> phase_labels = {{
+        {"worker", "parse"},
+        {"worker", "serialize"},
+        {"matrix", "projection"},
+        {"matrix", "locations"},
+        {"matrix", "computation"},
+        {"matrix", "response"},
+        {"direct_path", "projection"},
+        {"direct_path", "path"},
+        {"direct_path", "trip_leg"},
+        {"direct_path", "directions"},
+        {"direct_path", "response"},
+    }};
+    for (size_t i = 0; i < phase_labels.size(); ++i) {
+        // from 100us to 13s
+        phase_histograms[i] = &phase_family.Add({{"api", phase_labels[i].first}, {"phase", phase_labels[i].second}},
+                                                create_exponential_buckets(0.0001, 2, 18));
+    }
+
+    auto& warmup_family = prometheus::BuildGauge()
+                              .Name("asgard_tile_warmup_tiles")
+                              .Help("Nb of tiles of the profile loaded by the warmup, out of the total")
+                              .Register(*registry);
+    warmup_loaded_tiles = &warmup_family.Add({{"state", "loaded"}});
+    warmup_total_tiles = &warmup_family.Add({{"state", "total"}});
+
+    warmup_duration = &prometheus::BuildGauge()
+                           .Name("asgard_tile_warmup_duration_seconds")
+                           .Help("time spent by the warmup of the hottest tiles")
+                           .Register(*registry)
+                           .Add({});
+
+    ready_gauge = &prometheus::BuildGauge()
+                       .Name("asgard_ready")
+                       .Help("1 once the startup pre-projection of the stop list is done")
+                       .Register(*registry)
+                       .Add({});
 }
 
 InFlightGuard Metrics::start_in_flight() const {
@@ -154,19 +284,84 @@ void Metrics::observe_handle_matrix(const std::string& mode, double duration) co
     }
 }
 
-void Metrics::observe_nb_cache_miss(uint64_t nb_cache_miss, uint64_t nb_cache_calls) const {
+void Metrics::observe_nb_cache_miss(uint64_t nb_cache_miss, uint64_t nb_cache_calls, uint64_t nb_cache_rejected) const {
     if (!registry) {
         return;
     }
     nb_cache_miss_gauge->Set(nb_cache_miss);
     nb_cache_call_gauge->Set(nb_cache_calls);
+    nb_cache_rejected_gauge->Set(nb_cache_rejected);
 }
 
-void Metrics::observe_cache_size(uint64_t cache_size) const {
+void Metrics::observe_cache_size(uint64_t cache_size, uint64_t cache_bytes) const {
     if (!registry) {
         return;
     }
     current_cache_size->Set(cache_size);
+    current_cache_bytes->Set(cache_bytes);
+    cache_bytes_per_entry->Set(cache_size ? static_cast<double>(cache_bytes) / cache_size : 0);
+}
+
+void Metrics::observe_negative_cache(uint64_t nb_hits, uint64_t cache_size) const {
+    if (!registry) {
+        return;
+    }
+    nb_negative_cache_hits_gauge->Set(nb_hits);
+    current_negative_cache_size->Set(cache_size);
+}
+
+void Metrics::observe_request_allocations(uint64_t nb_allocations, uint64_t arena_bytes) const {
+    if (!registry) {
+        return;
+    }
+    allocations_histogram->Observe(nb_allocations);
+    arena_bytes_histogram->Observe(arena_bytes);
+}
+
+void Metrics::observe_matrix_cache(uint64_t nb_hits, uint64_t nb_misses) const {
+    if (!registry) {
+        return;
+    }
+    matrix_cache_hits->Increment(nb_hits);
+    matrix_cache_misses->Increment(nb_misses);
+}
+
+void Metrics::observe_crow_fly_pruned_cells(uint64_t nb_pruned_cells) const {
+    if (!registry) {
+        return;
+    }
+    crow_fly_pruned_cells->Increment(nb_pruned_cells);
+}
+
+void Metrics::observe_matrix_dedup(uint64_t nb_locations, uint64_t nb_distinct_locations) const {
+    if (!registry) {
+        return;
+    }
+    dedup_input_locations->Increment(nb_locations);
+    dedup_distinct_locations->Increment(nb_distinct_locations);
+}
+
+void Metrics::set_ready(bool ready) const {
+    if (!registry) {
+        return;
+    }
+    ready_gauge->Set(ready ? 1 : 0);
+}
+
+void Metrics::observe_phase(Phase phase, double duration) const {
+    if (!registry) {
+        return;
+    }
+    phase_histograms[static_cast<size_t>(phase)]->Observe(duration);
+}
+
+void Metrics::observe_tile_warmup(uint64_t nb_loaded_tiles, uint64_t nb_tiles, double duration) const {
+    if (!registry) {
+        return;
+    }
+    warmup_loaded_tiles->Set(nb_loaded_tiles);
+    warmup_total_tiles->Set(nb_tiles);
+    warmup_duration->Set(duration);
 }
 
 } // namespace asgard
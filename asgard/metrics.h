@@ -4,6 +4,8 @@
 #include <boost/core/noncopyable.hpp>
 #include <boost/optional.hpp>
 
+#include <array>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
@@ -12,6 +14,7 @@ namespace prometheus {
 class Registry;
 class Histogram;
 class Gauge;
+class Counter;
 } // namespace prometheus
 
 namespace asgard {
@@ -30,6 +33,22 @@ public:
     ~InFlightGuard();
 };
 
+// Steps of a request, each one with its own duration histogram
+enum class Phase {
+    parse,
+    serialize,
+    matrix_projection,
+    matrix_locations,
+    matrix_computation,
+    matrix_response,
+    direct_path_projection,
+    direct_path_path,
+    direct_path_trip_leg,
+    direct_path_directions,
+    direct_path_response,
+    count
+};
+
 class Metrics : boost::noncopyable {
 protected:
     std::unique_ptr<prometheus::Exposer> exposer;
@@ -40,7 +59,24 @@ protected:
     std::map<const std::string, prometheus::Histogram*> handle_matrix_histogram;
     prometheus::Gauge* nb_cache_miss_gauge;
     prometheus::Gauge* nb_cache_call_gauge;
+    prometheus::Gauge* nb_cache_rejected_gauge;
     prometheus::Gauge* current_cache_size;
+    prometheus::Gauge* current_cache_bytes;
+    prometheus::Gauge* cache_bytes_per_entry;
+    prometheus::Gauge* nb_negative_cache_hits_gauge;
+    prometheus::Gauge* current_negative_cache_size;
+    prometheus::Histogram* allocations_histogram;
+    prometheus::Counter* matrix_cache_hits;
+    prometheus::Counter* matrix_cache_misses;
+    prometheus::Counter* crow_fly_pruned_cells;
+    prometheus::Counter* dedup_input_locations;
+    prometheus::Counter* dedup_distinct_locations;
+    prometheus::Histogram* arena_bytes_histogram;
+    prometheus::Gauge* ready_gauge;
+    std::array<prometheus::Histogram*, static_cast<size_t>(Phase::count)> phase_histograms;
+    prometheus::Gauge* warmup_loaded_tiles;
+    prometheus::Gauge* warmup_total_tiles;
+    prometheus::Gauge* warmup_duration;
 
 public:
     explicit Metrics(const boost::optional<const AsgardConf&>& config);
@@ -48,8 +84,32 @@ public:
 
     void observe_handle_direct_path(const std::string&, double duration) const;
     void observe_handle_matrix(const std::string&, double duration) const;
-    void observe_nb_cache_miss(uint64_t nb_cache_miss, uint64_t nb_cache_calls) const;
-    void observe_cache_size(uint64_t cache_size) const;
+    void observe_nb_cache_miss(uint64_t nb_cache_miss, uint64_t nb_cache_calls, uint64_t nb_cache_rejected) const;
+    void observe_cache_size(uint64_t cache_size, uint64_t cache_bytes) const;
+    void observe_negative_cache(uint64_t nb_hits, uint64_t cache_size) const;
+    void observe_request_allocations(uint64_t nb_allocations, uint64_t arena_bytes) const;
+    void observe_matrix_cache(uint64_t nb_hits, uint64_t nb_misses) const;
+    void observe_crow_fly_pruned_cells(uint64_t nb_pruned_cells) const;
+    void observe_matrix_dedup(uint64_t nb_locations, uint64_t nb_distinct_locations) const;
+    void set_ready(bool ready) const;
+    void observe_phase(Phase phase, double duration) const;
+    void observe_tile_warmup(uint64_t nb_loaded_tiles, uint64_t nb_tiles, double duration) const;
+};
+
+// Time consecutive phases with a monotonic clock: each call to finish()
+// observes the time elapsed since the previous one, or since the construction
+class PhaseTimer {
+    const Metrics& metrics;
+    std::chrono::steady_clock::time_point last;
+
+public:
+    explicit PhaseTimer(const Metrics& metrics) : metrics(metrics), last(std::chrono::steady_clock::now()) {}
+
+    void finish(Phase phase) {
+        const auto now = std::chrono::steady_clock::now();
+        metrics.observe_phase(phase, std::chrono::duration<double>(now - last).count());
+        last = now;
+    }
 };
 
 } // namespace asgard
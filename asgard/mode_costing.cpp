@@ -5,6 +5,8 @@
 #include <valhalla/proto/options.pb.h>
 #include <valhalla/sif/costconstants.h>
 
+#include <boost/functional/hash.hpp>
+
 using namespace valhalla;
 using vc = valhalla::Costing;
 
@@ -42,25 +44,64 @@ Options make_costing_option(const ModeCostingArgs& args) {
 
     return options;
 }
+
+Costing make_mode_costing(sif::CostFactory& factory, const ModeCostingArgs& args) {
+    auto new_options = make_costing_option(args);
+    auto travel_mode = util::convert_navitia_to_valhalla_mode(args.mode);
+    return factory.CreateModeCosting(new_options, travel_mode);
+}
 } // namespace
 
-ModeCosting::ModeCosting() {
+bool operator==(const ModeCostingArgs& lhs, const ModeCostingArgs& rhs) {
+    return lhs.mode == rhs.mode &&
+           lhs.speeds == rhs.speeds &&
+           lhs.bss_rent_duration == rhs.bss_rent_duration &&
+           lhs.bss_rent_penalty == rhs.bss_rent_penalty &&
+           lhs.bss_return_duration == rhs.bss_return_duration &&
+           lhs.bss_return_penalty == rhs.bss_return_penalty;
+}
+
+size_t hash_value(const ModeCostingArgs& args) {
+    size_t seed = 0;
+    boost::hash_combine(seed, args.mode);
+    boost::hash_range(seed, args.speeds.begin(), args.speeds.end());
+    boost::hash_combine(seed, args.bss_rent_duration);
+    boost::hash_combine(seed, args.bss_rent_penalty);
+    boost::hash_combine(seed, args.bss_return_duration);
+    boost::hash_combine(seed, args.bss_return_penalty);
+    return seed;
+}
+
+std::shared_ptr<const Costing> CostingCache::get(const ModeCostingArgs& args) {
+    const auto search = costings.find(args);
+    if (search != costings.end()) {
+        return search->second;
+    }
+    sif::CostFactory factory;
+    auto costing = std::make_shared<const Costing>(make_mode_costing(factory, args));
+    if (costings.size() >= max_size) {
+        return costing;
+    }
+    return costings.emplace(args, std::move(costing)).first->second;
+}
+
+ModeCosting::ModeCosting(size_t cache_size) : cache(cache_size) {
     Options options;
     rapidjson::Document doc;
     sif::ParseCostingOptions(doc, "/costing_options", options);
+    Costing default_costing;
     for (const auto& mode : {"car", "taxi", "walking", "bike"}) {
-        costing[util::navitia_to_valhalla_mode_index(mode)] = factory.Create(options.costing_options(util::convert_navitia_to_valhalla_costing(mode)));
+        default_costing[util::navitia_to_valhalla_mode_index(mode)] = factory.Create(options.costing_options(util::convert_navitia_to_valhalla_costing(mode)));
     }
+    costing = std::make_shared<const Costing>(std::move(default_costing));
 }
 
 void ModeCosting::update_costing(const ModeCostingArgs& args) {
-    auto new_options = make_costing_option(args);
-    auto travel_mode = util::convert_navitia_to_valhalla_mode(args.mode);
-    costing = factory.CreateModeCosting(new_options, travel_mode);
+    costing = cache.get(args);
 }
 
 const valhalla::sif::cost_ptr_t ModeCosting::get_costing_for_mode(const std::string& mode) const {
-    return costing[util::navitia_to_valhalla_mode_index(mode)];
+    return (*costing)[util::navitia_to_valhalla_mode_index(mode)];
 }
 
 } // namespace asgard
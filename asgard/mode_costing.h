@@ -3,6 +3,12 @@
 #include <valhalla/sif/costfactory.h>
 #include <valhalla/sif/dynamiccost.h>
 
+#include <boost/core/noncopyable.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <memory>
+#include <unordered_map>
+
 namespace asgard {
 
 static const size_t mode_costing_size = static_cast<size_t>(valhalla::sif::TravelMode::kMaxTravelMode);
@@ -27,20 +33,46 @@ struct ModeCostingArgs {
     }
 };
 
+bool operator==(const ModeCostingArgs& lhs, const ModeCostingArgs& rhs);
+
+// Hash of all the parameters of the costing, including the mode
+size_t hash_value(const ModeCostingArgs& args);
+
+// Sets of arguments whose costings a worker keeps by default
+static const size_t default_costing_cache_size = 256;
+
+// Costings already built by a worker for each set of arguments.
+// Not thread safe: each worker has its own, valhalla doesn't guarantee its costs can be shared between threads
+class CostingCache : boost::noncopyable {
+public:
+    // Beyond max_size sets of arguments, the costings are built but not kept
+    explicit CostingCache(size_t max_size = default_costing_cache_size) : max_size(max_size) {}
+
+    std::shared_ptr<const Costing> get(const ModeCostingArgs& args);
+
+    size_t size() const { return costings.size(); }
+
+private:
+    std::unordered_map<ModeCostingArgs, std::shared_ptr<const Costing>, boost::hash<ModeCostingArgs>> costings;
+    size_t max_size;
+};
+
 class ModeCosting {
 public:
-    ModeCosting();
+    // Keep the costings of the last cache_size sets of arguments, 0 to build them for each update
+    explicit ModeCosting(size_t cache_size = 0);
     ModeCosting(const ModeCosting&) = delete;
 
     void update_costing(const ModeCostingArgs& args);
 
     const valhalla::sif::cost_ptr_t get_costing_for_mode(const std::string& mode) const;
 
-    const Costing& get_costing() const { return costing; }
+    const Costing& get_costing() const { return *costing; }
 
 private:
     valhalla::sif::CostFactory factory;
-    Costing costing;
+    std::shared_ptr<const Costing> costing;
+    CostingCache cache;
 };
 
 } // namespace asgard
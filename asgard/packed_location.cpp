@@ -0,0 +1,69 @@
+#include "asgard/packed_location.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace asgard {
+
+namespace {
+
+constexpr uint64_t GRAPH_ID_MASK = (uint64_t(1) << 46) - 1;
+constexpr int SIDE_OF_STREET_SHIFT = 46;
+constexpr uint64_t FILTERED_BIT = uint64_t(1) << 48;
+constexpr double E7 = 1e7;
+
+uint16_t clamp_reach(unsigned int reach) {
+    return static_cast<uint16_t>(std::min<unsigned int>(reach, std::numeric_limits<uint16_t>::max()));
+}
+
+void pack_edge(const valhalla::baldr::PathLocation::PathEdge& edge, bool filtered, PackedLocation& packed) {
+    PackedEdge p;
+    p.bits = (edge.id.value & GRAPH_ID_MASK) |
+             (static_cast<uint64_t>(edge.sos) << SIDE_OF_STREET_SHIFT) |
+             (filtered ? FILTERED_BIT : 0);
+    p.percent_along = edge.percent_along;
+    p.distance = edge.distance;
+    p.projected_heading = edge.projected_heading;
+    p.projected_lng = static_cast<int32_t>(std::round(edge.projected.lng() * E7));
+    p.projected_lat = static_cast<int32_t>(std::round(edge.projected.lat() * E7));
+    p.outbound_reach = clamp_reach(edge.outbound_reach);
+    p.inbound_reach = clamp_reach(edge.inbound_reach);
+    packed.push_back(p);
+}
+
+} // namespace
+
+PackedLocation pack(const valhalla::baldr::PathLocation& path_location) {
+    PackedLocation packed;
+    packed.reserve(path_location.edges.size() + path_location.filtered_edges.size());
+    for (const auto& edge : path_location.edges) {
+        pack_edge(edge, false, packed);
+    }
+    for (const auto& edge : path_location.filtered_edges) {
+        pack_edge(edge, true, packed);
+    }
+    return packed;
+}
+
+valhalla::baldr::PathLocation unpack(const PackedLocation& packed, const valhalla::baldr::Location& location) {
+    valhalla::baldr::PathLocation path_location(location);
+    for (const auto& p : packed) {
+        auto& edges = (p.bits & FILTERED_BIT) ? path_location.filtered_edges : path_location.edges;
+        edges.emplace_back(valhalla::baldr::GraphId(p.bits & GRAPH_ID_MASK),
+                           p.percent_along,
+                           valhalla::midgard::PointLL(p.projected_lng / E7, p.projected_lat / E7),
+                           p.distance,
+                           static_cast<valhalla::baldr::PathLocation::SideOfStreet>((p.bits >> SIDE_OF_STREET_SHIFT) & 3),
+                           p.outbound_reach,
+                           p.inbound_reach,
+                           p.projected_heading);
+    }
+    return path_location;
+}
+
+size_t PackedLocationHeapSize::operator()(const PackedLocation& packed) const {
+    return packed.capacity() > NB_INLINE_EDGES ? packed.capacity() * sizeof(PackedEdge) : 0;
+}
+
+} // namespace asgard
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <valhalla/baldr/pathlocation.h>
+
+#include <boost/container/small_vector.hpp>
+
+#include <cstdint>
+
+namespace asgard {
+
+// What PathLocation::toPBF needs of an edge a place is projected on, in 32 bytes
+struct PackedEdge {
+    // the graph id on the 46 low bits, then the side of street on 2 bits,
+    // and whether the edge is one of the filtered edges
+    uint64_t bits;
+    float percent_along;
+    float distance;
+    float projected_heading;
+    // in 1e-7 degrees
+    int32_t projected_lng;
+    int32_t projected_lat;
+    uint16_t outbound_reach;
+    uint16_t inbound_reach;
+};
+
+// Most places are projected in the middle of a way, on its 2 directed edges,
+// which are then stored inline without any allocation
+constexpr size_t NB_INLINE_EDGES = 2;
+using PackedLocation = boost::container::small_vector<PackedEdge, NB_INLINE_EDGES>;
+
+PackedLocation pack(const valhalla::baldr::PathLocation& path_location);
+
+// Rebuild a PathLocation of location with the packed edges
+valhalla::baldr::PathLocation unpack(const PackedLocation& packed, const valhalla::baldr::Location& location);
+
+// The bytes packed allocates when its edges don't fit inline
+struct PackedLocationHeapSize {
+    size_t operator()(const PackedLocation& packed) const;
+};
+
+} // namespace asgard
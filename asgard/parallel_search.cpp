@@ -0,0 +1,125 @@
+#include "asgard/parallel_search.h"
+
+#include "asgard/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+using namespace valhalla;
+
+namespace asgard {
+
+namespace {
+
+using SearchResult = std::unordered_map<baldr::Location, baldr::PathLocation>;
+
+// Interleave the bits of v with zeros
+uint64_t spread_bits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+uint32_t quantize(double value, double min, double max) {
+    const auto ratio = std::min(1., std::max(0., (value - min) / (max - min)));
+    return static_cast<uint32_t>(ratio * 0xffffffffu);
+}
+
+// Shared with the helpers, which may start after the caller returned:
+// they then find no chunk left and never touch the graph nor the costing
+struct SearchState {
+    std::vector<std::vector<baldr::Location>> chunks;
+    std::vector<SearchResult> results;
+    std::atomic<size_t> next_chunk{0};
+    std::mutex mutex;
+    std::condition_variable all_done;
+    size_t nb_done = 0;
+    std::exception_ptr error;
+};
+
+void search_chunks(SearchState& state, baldr::GraphReader& graph, const sif::cost_ptr_t& costing) {
+    for (auto i = state.next_chunk++; i < state.chunks.size(); i = state.next_chunk++) {
+        SearchResult result;
+        std::exception_ptr error;
+        try {
+            result = loki::Search(state.chunks[i], graph, costing);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.results[i] = std::move(result);
+        if (error && !state.error) {
+            state.error = error;
+        }
+        if (++state.nb_done == state.chunks.size()) {
+            state.all_done.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+uint64_t get_z_order(const midgard::PointLL& place) {
+    return spread_bits(quantize(place.lng(), -180, 180)) | (spread_bits(quantize(place.lat(), -90, 90)) << 1);
+}
+
+SearchResult parallel_search(std::vector<baldr::Location> locations,
+                             baldr::GraphReader& graph,
+                             const sif::cost_ptr_t& costing,
+                             ThreadPool& pool,
+                             size_t chunk_size) {
+    if (pool.size() == 0 || chunk_size == 0 || locations.size() <= chunk_size) {
+        return loki::Search(locations, graph, costing);
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> order;
+    order.reserve(locations.size());
+    for (size_t i = 0; i < locations.size(); ++i) {
+        order.emplace_back(get_z_order(locations[i].latlng_), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    auto state = std::make_shared<SearchState>();
+    for (size_t begin = 0; begin < order.size(); begin += chunk_size) {
+        const auto end = std::min(order.size(), begin + chunk_size);
+        state->chunks.emplace_back();
+        state->chunks.back().reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            state->chunks.back().push_back(std::move(locations[order[i].second]));
+        }
+    }
+    state->results.resize(state->chunks.size());
+
+    const auto nb_helpers = std::min(pool.size(), state->chunks.size() - 1);
+    for (size_t i = 0; i < nb_helpers; ++i) {
+        pool.submit([state, &graph, costing]() { search_chunks(*state, graph, costing); });
+    }
+    search_chunks(*state, graph, costing);
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->all_done.wait(lock, [&state]() { return state->nb_done == state->chunks.size(); });
+    }
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+
+    // The chunks are merged in one pass, so the caller fills the cache once
+    SearchResult merged;
+    merged.reserve(locations.size());
+    for (auto& result : state->results) {
+        for (auto& r : result) {
+            merged.emplace(r.first, std::move(r.second));
+        }
+    }
+    return merged;
+}
+
+} // namespace asgard
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <valhalla/loki/search.h>
+#include <valhalla/midgard/pointll.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace asgard {
+
+class ThreadPool;
+
+// Position of the place along a Z-order curve: the places close along the curve are close on the map
+uint64_t get_z_order(const valhalla::midgard::PointLL& place);
+
+// Search the locations with loki, in chunks of chunk_size searched in parallel on the pool.
+// The locations are sorted along a Z-order curve before being cut, so that each chunk only reads
+// a few tiles. The calling thread searches chunks too, and only waits for the chunks being
+// searched by the helpers: it can be a helper thread of the same pool without any deadlock.
+std::unordered_map<valhalla::baldr::Location, valhalla::baldr::PathLocation>
+parallel_search(std::vector<valhalla::baldr::Location> locations,
+                valhalla::baldr::GraphReader& graph,
+                const valhalla::sif::cost_ptr_t& costing,
+                ThreadPool& pool,
+                size_t chunk_size);
+
+} // namespace asgard
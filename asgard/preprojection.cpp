@@ -0,0 +1,90 @@
+#include "asgard/preprojection.h"
+
+#include "utils/coord_parser.h"
+#include "asgard/mode_costing.h"
+#include "asgard/projector.h"
+#include "asgard/thread_pool.h"
+
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/midgard/logging.h>
+
+#include <boost/algorithm/string/trim.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+
+using namespace valhalla;
+
+namespace asgard {
+
+namespace preprojection {
+
+std::vector<midgard::PointLL> read_stop_list(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        LOG_ERROR("Cannot read stop list " + path);
+        return {};
+    }
+
+    std::vector<midgard::PointLL> places;
+    size_t nb_invalid = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        boost::algorithm::trim(line);
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        try {
+            const auto coord = navitia::parse_coordinate(line);
+            places.emplace_back(coord.first, coord.second);
+        } catch (const navitia::wrong_coordinate&) {
+            ++nb_invalid;
+        }
+    }
+    if (nb_invalid > 0) {
+        LOG_WARN(std::to_string(nb_invalid) + " invalid coordinates skipped in " + path);
+    }
+    return places;
+}
+
+size_t preproject(const Projector& projector,
+                  const std::vector<midgard::PointLL>& places,
+                  const std::vector<std::string>& modes,
+                  baldr::GraphReader& graph,
+                  ThreadPool& pool,
+                  size_t chunk_size,
+                  const ProgressCallback& on_progress) {
+    chunk_size = std::max<size_t>(1, chunk_size);
+
+    std::vector<std::future<size_t>> chunks;
+    for (const auto& mode : modes) {
+        for (size_t begin = 0; begin < places.size(); begin += chunk_size) {
+            const auto end = std::min(places.size(), begin + chunk_size);
+            chunks.push_back(pool.submit([&projector, &places, &graph, mode, begin, end]() {
+                // the costings are not shared between threads
+                ModeCosting mode_costing;
+                const auto costing = mode_costing.get_costing_for_mode(mode);
+                return projector(places.begin() + begin, places.begin() + end, graph, mode, costing).size();
+            }));
+        }
+    }
+
+    // Every chunk is waited for, even after an error, since they all reference places
+    size_t nb_projected = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        try {
+            nb_projected += chunks[i].get();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Pre-projection of a chunk failed: " + std::string(e.what()));
+        }
+        if (on_progress) {
+            on_progress(i + 1, chunks.size());
+        }
+    }
+    return nb_projected;
+}
+
+} // namespace preprojection
+
+} // namespace asgard
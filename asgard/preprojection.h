@@ -0,0 +1,42 @@
+#pragma once
+
+#include <valhalla/midgard/pointll.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace valhalla {
+namespace baldr {
+class GraphReader;
+}
+} // namespace valhalla
+
+namespace asgard {
+
+class Projector;
+class ThreadPool;
+
+namespace preprojection {
+
+// Called after each chunk with the number of chunks done and the total number of chunks
+using ProgressCallback = std::function<void(size_t, size_t)>;
+
+// Read one coordinate per line, in any format accepted by navitia::parse_coordinate.
+// Empty lines and lines starting with '#' are skipped, invalid ones are logged and skipped
+std::vector<valhalla::midgard::PointLL> read_stop_list(const std::string& path);
+
+// Project every place for every mode into the projector's cache.
+// The places are split in chunks of chunk_size projected in parallel on the pool, which must not be empty.
+// Return the number of successful projections
+size_t preproject(const Projector& projector,
+                  const std::vector<valhalla::midgard::PointLL>& places,
+                  const std::vector<std::string>& modes,
+                  valhalla::baldr::GraphReader& graph,
+                  ThreadPool& pool,
+                  size_t chunk_size,
+                  const ProgressCallback& on_progress = ProgressCallback());
+
+} // namespace preprojection
+
+} // namespace asgard
@@ -1,31 +1,113 @@
 #pragma once
 
 #include "utils/coord_parser.h"
+#include "asgard/clock_cache.h"
+#include "asgard/packed_location.h"
+#include "asgard/parallel_search.h"
 
 #include <valhalla/loki/search.h>
 #include <valhalla/midgard/pointll.h>
 
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/member.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
 
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace asgard {
 
+// The modes with their own projections, bss places are projected as walking ones
+enum class ProjectionMode : uint8_t {
+    walking,
+    bike,
+    car,
+    taxi,
+};
+
+inline boost::optional<ProjectionMode> to_projection_mode(const std::string& mode) {
+    if (mode == "walking" || mode == "bss") {
+        return ProjectionMode::walking;
+    }
+    if (mode == "bike") {
+        return ProjectionMode::bike;
+    }
+    if (mode == "car") {
+        return ProjectionMode::car;
+    }
+    if (mode == "taxi") {
+        return ProjectionMode::taxi;
+    }
+    return boost::none;
+}
+
+inline std::string to_string(ProjectionMode mode) {
+    switch (mode) {
+    case ProjectionMode::walking:
+        return "walking";
+    case ProjectionMode::bike:
+        return "bike";
+    case ProjectionMode::car:
+        return "car";
+    case ProjectionMode::taxi:
+        return "taxi";
+    }
+    return "";
+}
+
+struct ProjectorOptions {
+    // maximal cached values
+    size_t cache_size = 1000;
+    unsigned int min_outbound_reach = 0;
+    unsigned int min_inbound_reach = 0;
+    unsigned int radius = 0;
+    size_t nb_shards = 16;
+    // in meters, places closer than this share their projection in the cache. 0 to use the exact coordinates
+    double grid_cell_size = 0;
+    // failed projections kept to not search them again before negative_cache_ttl seconds, 0 to disable it
+    size_t negative_cache_size = 0;
+    unsigned int negative_cache_ttl = 600;
+    // approximate memory budget of the cache in bytes, 0 to only bound its number of entries
+    size_t cache_bytes = 0;
+    // a full cache only admits the places looked up more often than their victim
+    bool cache_admission = false;
+    // helpers searching the misses in parallel beyond search_chunk_size misses, nullptr to search them on the caller.
+    // It must outlive the projector
+    ThreadPool* search_pool = nullptr;
+    size_t search_chunk_size = 0;
+};
+
 class Projector {
 private:
     friend class UnitTestProjector;
 
-    typedef std::pair<valhalla::midgard::PointLL, std::string> key_type;
-    typedef valhalla::baldr::PathLocation mapped_type;
-    typedef std::pair<const key_type, mapped_type> value_type;
-    typedef boost::multi_index_container<
-        value_type,
-        boost::multi_index::indexed_by<
-            boost::multi_index::sequenced<>,
-            boost::multi_index::hashed_unique<
-                boost::multi_index::member<value_type, const key_type, &value_type::first>>>>
-        Cache;
+    struct key_type {
+        valhalla::midgard::PointLL place;
+        ProjectionMode mode;
+
+        bool operator==(const key_type& other) const {
+            return place == other.place && mode == other.mode;
+        }
+    };
+    // Only the edges are kept, the rest of the PathLocation is rebuilt from the place
+    typedef PackedLocation mapped_type;
+
+    struct KeyHasher {
+        size_t operator()(const key_type& key) const {
+            size_t seed = std::hash<valhalla::midgard::PointLL>{}(key.place);
+            boost::hash_combine(seed, static_cast<uint8_t>(key.mode));
+            return seed;
+        }
+    };
+
+    // Below this number of entries per shard, sharding is not worth it
+    static constexpr size_t MIN_SHARD_CAPACITY = 64;
+    static constexpr double METERS_PER_DEGREE = 111195;
 
     // maximal cached values
     size_t cache_size;
@@ -35,12 +117,25 @@ private:
 
     unsigned int radius;
 
+    // Size in meters of the cells of the grid the places are snapped on to build the cache keys,
+    // so that places closer than this share their projection. 0 to use the exact coordinates
+    double grid_cell_size;
+
     // the cache, mutable because side effect are not visible from the
     // exterior because of the purity of f
-    mutable Cache cache;
-    mutable size_t nb_cache_miss = 0;
-    mutable size_t nb_cache_calls = 0;
-    mutable std::mutex mutex;
+    mutable ClockCache<key_type, mapped_type, KeyHasher, PackedLocationHeapSize> cache;
+    mutable std::atomic<size_t> nb_cache_miss{0};
+    mutable std::atomic<size_t> nb_cache_calls{0};
+
+    // The places whose projection failed, with the time of the failure. They are not searched
+    // again before negative_cache_ttl, since loki would most likely fail again
+    mutable ClockCache<key_type, std::chrono::steady_clock::time_point, KeyHasher> negative_cache;
+    std::chrono::steady_clock::duration negative_cache_ttl;
+    mutable std::atomic<size_t> nb_negative_cache_hits{0};
+
+    // Helpers searching the misses in parallel by chunks of search_chunk_size, see parallel_search.h
+    ThreadPool* search_pool;
+    size_t search_chunk_size;
 
     valhalla::baldr::Location build_location(const valhalla::midgard::PointLL& place,
                                              unsigned int min_outbound_reach,
@@ -54,14 +149,57 @@ private:
         return l;
     }
 
+    key_type make_key(const valhalla::midgard::PointLL& place, ProjectionMode mode) const {
+        if (grid_cell_size <= 0) {
+            return {place, mode};
+        }
+        // The columns are narrowed with the latitude of their row to stay grid_cell_size wide
+        const double lat_step = grid_cell_size / METERS_PER_DEGREE;
+        const double lat = std::round(place.lat() / lat_step) * lat_step;
+        const double lng_step = lat_step / std::max(std::cos(lat * M_PI / 180), 0.01);
+        const double lng = std::round(place.lng() / lng_step) * lng_step;
+        return {valhalla::midgard::PointLL(lng, lat), mode};
+    }
+
+    static ProjectorOptions make_options(size_t cache_size,
+                                         unsigned int min_outbound_reach,
+                                         unsigned int min_inbound_reach,
+                                         unsigned int radius) {
+        ProjectorOptions options;
+        options.cache_size = cache_size;
+        options.min_outbound_reach = min_outbound_reach;
+        options.min_inbound_reach = min_inbound_reach;
+        options.radius = radius;
+        return options;
+    }
+
+    std::unordered_map<valhalla::baldr::Location, valhalla::baldr::PathLocation>
+    search(const std::vector<valhalla::baldr::Location>& locations,
+           valhalla::baldr::GraphReader& graph,
+           const valhalla::sif::cost_ptr_t& costing) const {
+        if (search_pool == nullptr) {
+            return valhalla::loki::Search(locations, graph, costing);
+        }
+        return parallel_search(locations, graph, costing, *search_pool, search_chunk_size);
+    }
+
 public:
+    explicit Projector(const ProjectorOptions& options) : cache_size(options.cache_size),
+                                                          min_outbound_reach(options.min_outbound_reach),
+                                                          min_inbound_reach(options.min_inbound_reach),
+                                                          radius(options.radius),
+                                                          grid_cell_size(options.grid_cell_size),
+                                                          cache(options.cache_size, options.nb_shards, MIN_SHARD_CAPACITY,
+                                                                options.cache_bytes, options.cache_admission),
+                                                          negative_cache(options.negative_cache_size, options.nb_shards, MIN_SHARD_CAPACITY),
+                                                          negative_cache_ttl(std::chrono::seconds(options.negative_cache_ttl)),
+                                                          search_pool(options.search_pool),
+                                                          search_chunk_size(options.search_chunk_size) {}
+
     explicit Projector(size_t cache_size = 1000,
                        unsigned int min_outbound_reach = 0,
                        unsigned int min_inbound_reach = 0,
-                       unsigned int radius = 0) : cache_size(cache_size),
-                                                  min_outbound_reach(min_outbound_reach),
-                                                  min_inbound_reach(min_inbound_reach),
-                                                  radius(radius) {}
+                       unsigned int radius = 0) : Projector(make_options(cache_size, min_outbound_reach, min_inbound_reach, radius)) {}
 
     template<typename T>
     std::unordered_map<valhalla::midgard::PointLL, valhalla::baldr::PathLocation>
@@ -79,7 +217,31 @@ public:
 
     size_t get_nb_cache_miss() const { return nb_cache_miss; }
     size_t get_nb_cache_calls() const { return nb_cache_calls; }
-    size_t get_current_cache_size() const { return cache.template get<0>().size(); }
+    size_t get_nb_cache_rejected() const { return cache.get_nb_rejected(); }
+    size_t get_nb_shards() const { return cache.get_nb_shards(); }
+    size_t get_current_cache_size() const { return cache.size(); }
+    size_t get_cache_memory_usage() const { return cache.get_memory_usage(); }
+    size_t get_nb_negative_cache_hits() const { return nb_negative_cache_hits; }
+    size_t get_current_negative_cache_size() const { return negative_cache.size(); }
+
+    // Used to save and restore the cache, see projector_snapshot.h.
+    // With a grid, the places given to f are the ones of the grid.
+    // The entries are copied packed, one shard at a time, and unpacked for f without any lock
+    template<typename F>
+    void for_each_cached(F&& f) const {
+        cache.for_each([&](const key_type& key, const mapped_type& value) {
+            f(key.place, to_string(key.mode),
+              unpack(value, build_location(key.place, min_outbound_reach, min_inbound_reach, radius)));
+        });
+    }
+    void add_to_cache(const valhalla::midgard::PointLL& place,
+                      const std::string& mode,
+                      const valhalla::baldr::PathLocation& location) const {
+        const auto projection_mode = to_projection_mode(mode);
+        if (projection_mode) {
+            cache.insert(make_key(place, *projection_mode), pack(location));
+        }
+    }
 
 private:
     template<typename T>
@@ -89,40 +251,46 @@ private:
                        valhalla::baldr::GraphReader& graph,
                        const std::string& mode,
                        const valhalla::sif::cost_ptr_t& costing) const {
+        const auto projector_mode = to_projection_mode(mode);
+        if (!projector_mode) {
+            return project_without_cache(places_begin, places_end, graph, mode, costing);
+        }
         std::unordered_map<valhalla::midgard::PointLL, valhalla::baldr::PathLocation> results;
         std::vector<valhalla::baldr::Location> missed;
-        auto& list = cache.template get<0>();
-        const auto& map = cache.template get<1>();
-        auto projector_mode = mode;
-        if (projector_mode == "bss") {
-            projector_mode = "walking";
-        }
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            for (auto it = places_begin; it != places_end; ++it) {
-                ++nb_cache_calls;
-                const auto search = map.find(std::make_pair(*it, projector_mode));
-                if (search != map.end()) {
-                    // put the cached value at the begining of the cache
-                    list.relocate(list.begin(), cache.template project<0>(search));
-                    results.emplace(*it, search->second);
-                } else {
-                    ++nb_cache_miss;
-                    missed.push_back(build_location(*it, min_outbound_reach, min_inbound_reach, radius));
-                }
+        const auto now = std::chrono::steady_clock::now();
+        for (auto it = places_begin; it != places_end; ++it) {
+            ++nb_cache_calls;
+            const auto key = make_key(*it, *projector_mode);
+            const auto found = cache.find(key, [&](const mapped_type& value) {
+                results.emplace(*it, unpack(value, build_location(*it, min_outbound_reach, min_inbound_reach, radius)));
+            });
+            if (found) {
+                continue;
+            }
+            // A recent failure is missing from the results, as if the projection had failed again
+            bool failed_recently = false;
+            negative_cache.find(key, [&](const std::chrono::steady_clock::time_point& failure) {
+                failed_recently = now - failure < negative_cache_ttl;
+            });
+            if (failed_recently) {
+                ++nb_negative_cache_hits;
+                continue;
             }
+            ++nb_cache_miss;
+            missed.push_back(build_location(*it, min_outbound_reach, min_inbound_reach, radius));
         }
         if (!missed.empty()) {
-            const auto path_locations = valhalla::loki::Search(missed,
-                                                               graph,
-                                                               costing);
+            const auto path_locations = search(missed, graph, costing);
 
-            std::lock_guard<std::mutex> lock(mutex);
             for (const auto& l : path_locations) {
-                list.push_front(std::make_pair(std::make_pair(l.first.latlng_, projector_mode), l.second));
+                cache.insert(make_key(l.first.latlng_, *projector_mode), pack(l.second));
                 results.emplace(l.first.latlng_, l.second);
             }
-            while (list.size() > cache_size) { list.pop_back(); }
+            for (const auto& l : missed) {
+                if (path_locations.find(l) == path_locations.end()) {
+                    negative_cache.insert(make_key(l.latlng_, *projector_mode), now);
+                }
+            }
         }
         return results;
     }
@@ -134,18 +302,12 @@ private:
                           valhalla::baldr::GraphReader& graph,
                           const std::string& mode,
                           const valhalla::sif::cost_ptr_t& costing) const {
-        auto projector_mode = mode;
-        if (projector_mode == "bss") {
-            projector_mode = "walking";
-        }
         std::vector<valhalla::baldr::Location> locations;
         std::transform(places_begin, places_end, std::back_inserter(locations),
                        [this](const valhalla::midgard::PointLL& place) {
                            return build_location(place, min_outbound_reach, min_inbound_reach, radius);
                        });
-        const auto path_locations = valhalla::loki::Search(locations,
-                                                           graph,
-                                                           costing);
+        const auto path_locations = search(locations, graph, costing);
 
         std::unordered_map<valhalla::midgard::PointLL, valhalla::baldr::PathLocation> results;
         for (const auto& l : path_locations) {
@@ -0,0 +1,204 @@
+#include "asgard/projector_snapshot.h"
+
+#include "asgard/projector.h"
+
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/midgard/logging.h>
+#include <valhalla/proto/tripcommon.pb.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+using namespace valhalla;
+
+namespace asgard {
+
+namespace projector_snapshot {
+
+namespace {
+
+// Bump it when the layout of the entries changes
+const char MAGIC[8] = {'A', 'S', 'G', 'P', 'R', 'J', '0', '1'};
+
+// Layout of the file, all integers in native endianness:
+//   magic, uint32 version size, version,
+//   uint64 number of entries,
+//   then for each entry: float lng, float lat, uint8 mode size, mode,
+//                        uint32 location size, serialized valhalla::Location
+template<typename T>
+void write_pod(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void write_string(std::ostream& out, const std::string& value) {
+    out.write(value.data(), value.size());
+}
+
+class Reader {
+public:
+    Reader(const char* begin, size_t size) : current(begin), end(begin + size) {}
+
+    template<typename T>
+    bool read_pod(T& value) {
+        if (static_cast<size_t>(end - current) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, current, sizeof(T));
+        current += sizeof(T);
+        return true;
+    }
+
+    bool read_bytes(size_t size, const char*& bytes) {
+        if (static_cast<size_t>(end - current) < size) {
+            return false;
+        }
+        bytes = current;
+        current += size;
+        return true;
+    }
+
+private:
+    const char* current;
+    const char* end;
+};
+
+} // namespace
+
+std::string get_tileset_version(baldr::GraphReader& graph) {
+    const auto tiles = graph.GetTileSet();
+    if (tiles.empty()) {
+        return "";
+    }
+    // every tile of an extract carries the same version and dataset id, any of them will do
+    const auto first = *std::min_element(tiles.begin(), tiles.end());
+    const auto tile = graph.GetGraphTile(first);
+    if (!tile) {
+        return "";
+    }
+    return tile->header()->version() + ":" + std::to_string(tile->header()->dataset_id()) + ":" + std::to_string(tiles.size());
+}
+
+size_t save(const Projector& projector,
+            const std::string& path,
+            const std::string& tileset_version,
+            baldr::GraphReader& graph) {
+    // each save has its own temporary file, two saves never write in the same one
+    const auto tmp_path = boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%.tmp").string();
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_ERROR("Cannot write projector snapshot in " + tmp_path);
+        return 0;
+    }
+
+    out.write(MAGIC, sizeof(MAGIC));
+    write_pod(out, static_cast<uint32_t>(tileset_version.size()));
+    write_string(out, tileset_version);
+    const auto nb_entries_pos = out.tellp();
+    write_pod(out, uint64_t(0));
+
+    // Only the packed entries of a shard are copied under its lock, each entry is unpacked, serialized
+    // and written without any lock, so that the workers are not kept waiting by the file
+    uint64_t nb_entries = 0;
+    valhalla::Location pbf;
+    std::string buffer;
+    projector.for_each_cached([&](const midgard::PointLL& place, const std::string& mode, const baldr::PathLocation& location) {
+        if (mode.size() > std::numeric_limits<uint8_t>::max()) {
+            return;
+        }
+        pbf.Clear();
+        baldr::PathLocation::toPBF(location, &pbf, graph);
+        // the names are only used by the responses, no need to keep them
+        for (auto& edge : *pbf.mutable_path_edges()) {
+            edge.clear_names();
+        }
+        pbf.SerializeToString(&buffer);
+
+        write_pod(out, static_cast<float>(place.lng()));
+        write_pod(out, static_cast<float>(place.lat()));
+        write_pod(out, static_cast<uint8_t>(mode.size()));
+        write_string(out, mode);
+        write_pod(out, static_cast<uint32_t>(buffer.size()));
+        write_string(out, buffer);
+        ++nb_entries;
+    });
+
+    out.seekp(nb_entries_pos);
+    write_pod(out, nb_entries);
+    out.close();
+    if (!out) {
+        LOG_ERROR("Failed to write projector snapshot in " + tmp_path);
+        std::remove(tmp_path.c_str());
+        return 0;
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Cannot move projector snapshot to " + path);
+        std::remove(tmp_path.c_str());
+        return 0;
+    }
+    return nb_entries;
+}
+
+size_t load(const Projector& projector,
+            const std::string& path,
+            const std::string& tileset_version) {
+    if (!boost::filesystem::exists(path) || boost::filesystem::file_size(path) == 0) {
+        LOG_INFO("No projector snapshot found in " + path);
+        return 0;
+    }
+
+    boost::iostreams::mapped_file_source file(path);
+    Reader reader(file.data(), file.size());
+
+    const char* magic = nullptr;
+    if (!reader.read_bytes(sizeof(MAGIC), magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_WARN("Ignoring projector snapshot " + path + ": unknown format");
+        return 0;
+    }
+    uint32_t version_size = 0;
+    const char* version = nullptr;
+    if (!reader.read_pod(version_size) || !reader.read_bytes(version_size, version)) {
+        LOG_WARN("Ignoring projector snapshot " + path + ": truncated file");
+        return 0;
+    }
+    if (std::string(version, version_size) != tileset_version) {
+        LOG_WARN("Ignoring projector snapshot " + path + ": made with tiles " + std::string(version, version_size) +
+                 " instead of " + tileset_version);
+        return 0;
+    }
+
+    uint64_t nb_entries = 0;
+    if (!reader.read_pod(nb_entries)) {
+        LOG_WARN("Ignoring projector snapshot " + path + ": truncated file");
+        return 0;
+    }
+
+    size_t nb_loaded = 0;
+    valhalla::Location pbf;
+    for (uint64_t i = 0; i < nb_entries; ++i) {
+        float lng = 0, lat = 0;
+        uint8_t mode_size = 0;
+        uint32_t location_size = 0;
+        const char* mode = nullptr;
+        const char* location = nullptr;
+        if (!reader.read_pod(lng) || !reader.read_pod(lat) ||
+            !reader.read_pod(mode_size) || !reader.read_bytes(mode_size, mode) ||
+            !reader.read_pod(location_size) || !reader.read_bytes(location_size, location) ||
+            !pbf.ParseFromArray(location, location_size)) {
+            LOG_WARN("Projector snapshot " + path + " is truncated, " + std::to_string(nb_loaded) + " entries restored");
+            break;
+        }
+        projector.add_to_cache(midgard::PointLL{lng, lat}, std::string(mode, mode_size), baldr::PathLocation::fromPBF(pbf));
+        ++nb_loaded;
+    }
+    return nb_loaded;
+}
+
+} // namespace projector_snapshot
+
+} // namespace asgard
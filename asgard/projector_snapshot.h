@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+namespace valhalla {
+namespace baldr {
+class GraphReader;
+}
+} // namespace valhalla
+
+namespace asgard {
+
+class Projector;
+
+namespace projector_snapshot {
+
+// Identify the tiles the projections were made on: a snapshot made with other tiles is rejected
+std::string get_tileset_version(valhalla::baldr::GraphReader& graph);
+
+// Write all the entries of the projector's cache in a binary file.
+// The file is written next to path then renamed, so a reader never sees a partial snapshot.
+// Return the number of entries written
+size_t save(const Projector& projector,
+            const std::string& path,
+            const std::string& tileset_version,
+            valhalla::baldr::GraphReader& graph);
+
+// Memory map the snapshot and restore its entries in the projector's cache.
+// Return the number of entries restored, 0 when the file is missing, invalid or stale
+size_t load(const Projector& projector,
+            const std::string& path,
+            const std::string& tileset_version);
+
+} // namespace projector_snapshot
+
+} // namespace asgard
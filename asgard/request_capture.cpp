@@ -0,0 +1,53 @@
+#include "asgard/request_capture.h"
+
+#include <valhalla/midgard/logging.h>
+
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace asgard {
+
+RequestRecorder::RequestRecorder(const std::string& path, double sampling) : out(path, std::ios::binary | std::ios::app),
+                                                                             sampling(sampling) {
+    if (!out) {
+        throw std::runtime_error("Cannot open capture file " + path);
+    }
+}
+
+void RequestRecorder::record(const void* data, size_t size) {
+    static thread_local std::mt19937 generator{std::random_device{}()};
+    if (std::uniform_real_distribution<double>(0, 1)(generator) >= sampling) {
+        return;
+    }
+    if (size > std::numeric_limits<uint32_t>::max()) {
+        return;
+    }
+    const auto frame_size = static_cast<uint32_t>(size);
+    std::lock_guard<std::mutex> lock(mutex);
+    out.write(reinterpret_cast<const char*>(&frame_size), sizeof(frame_size));
+    out.write(static_cast<const char*>(data), size);
+    // keep the file usable while asgard is running
+    out.flush();
+    ++nb_recorded;
+}
+
+std::vector<std::string> read_captured_requests(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open capture file " + path);
+    }
+    std::vector<std::string> requests;
+    uint32_t size = 0;
+    while (in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        std::string request(size, '\0');
+        if (!in.read(&request[0], size)) {
+            LOG_WARN("Capture file " + path + " is truncated");
+            break;
+        }
+        requests.push_back(std::move(request));
+    }
+    return requests;
+}
+
+} // namespace asgard
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asgard {
+
+// Record a sample of the raw requests received, to replay them later with asgard_replay.
+// Each request is written as its size on a native uint32 followed by the serialized pbnavitia::Request.
+class RequestRecorder : boost::noncopyable {
+public:
+    // sampling is the probability for a request to be recorded, between 0 and 1
+    RequestRecorder(const std::string& path, double sampling);
+
+    // Thread safe
+    void record(const void* data, size_t size);
+
+    size_t get_nb_recorded() const { return nb_recorded; }
+
+private:
+    std::mutex mutex;
+    std::ofstream out;
+    double sampling;
+    std::atomic<size_t> nb_recorded{0};
+};
+
+// Read all the requests of a capture file, stopping at the first truncated one
+std::vector<std::string> read_captured_requests(const std::string& path);
+
+} // namespace asgard
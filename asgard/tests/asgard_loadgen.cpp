@@ -0,0 +1,362 @@
+#include "utils/zmq.h"
+#include "asgard/request.pb.h"
+#include "asgard/response.pb.h"
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+// Send a mix of matrices and direct paths to a running asgard, through zmq as jormungandr does.
+// Instead of a REQ socket, a DEALER socket puts a sequence number in the envelope of each request,
+// which asgard sends back untouched, so many requests can be in flight on a single connection.
+// The matrices are not asked in stream, each request gets a single reply.
+
+namespace po = boost::program_options;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// One kind of request of the mix, written api/mode[/NxM]=weight, like "matrix/walking/1x100=5"
+// or "direct_path/bss=1". The size of the matrices defaults to 1x100
+struct Kind {
+    std::string name;
+    std::string api;
+    std::string mode;
+    size_t nb_origins = 1;
+    size_t nb_destinations = 100;
+    double weight = 1;
+};
+
+Kind parse_kind(const std::string& spec) {
+    Kind kind;
+    std::vector<std::string> name_weight;
+    boost::split(name_weight, spec, boost::is_any_of("="));
+    if (name_weight.size() > 2) {
+        throw std::invalid_argument("bad request kind: " + spec);
+    }
+    if (name_weight.size() == 2) {
+        kind.weight = std::stod(name_weight[1]);
+    }
+    kind.name = name_weight[0];
+
+    std::vector<std::string> parts;
+    boost::split(parts, kind.name, boost::is_any_of("/"));
+    if (parts.size() < 2) {
+        throw std::invalid_argument("bad request kind: " + spec);
+    }
+    kind.api = parts[0];
+    kind.mode = parts[1];
+    if (kind.api == "matrix" && parts.size() == 3) {
+        std::vector<std::string> size;
+        boost::split(size, parts[2], boost::is_any_of("x"));
+        if (size.size() != 2) {
+            throw std::invalid_argument("bad matrix size: " + spec);
+        }
+        kind.nb_origins = std::stoul(size[0]);
+        kind.nb_destinations = std::stoul(size[1]);
+    } else if (kind.api == "matrix" && parts.size() == 2) {
+        kind.name += "/" + std::to_string(kind.nb_origins) + "x" + std::to_string(kind.nb_destinations);
+    } else if (kind.api != "direct_path" || parts.size() != 2) {
+        throw std::invalid_argument("bad request kind: " + spec);
+    }
+    if (kind.weight <= 0 || kind.nb_origins == 0 || kind.nb_destinations == 0) {
+        throw std::invalid_argument("bad request kind: " + spec);
+    }
+    return kind;
+}
+
+float get_speed(const std::string& mode) {
+    return mode == "walking" || mode == "bss" ? 1.12 : mode == "bike" ? 4.1 : 11.11;
+}
+
+class RequestMaker {
+public:
+    RequestMaker(const std::vector<Kind>& kinds,
+                 double lon,
+                 double lat,
+                 double spread,
+                 size_t nb_places,
+                 unsigned int seed) : generator(seed) {
+        std::vector<double> weights;
+        for (const auto& k : kinds) {
+            weights.push_back(k.weight);
+        }
+        kind_distribution = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+        std::uniform_real_distribution<double> distribution(-spread, spread);
+        for (size_t i = 0; i < nb_places; ++i) {
+            places.push_back("coord:" + std::to_string(lon + distribution(generator)) + ":" +
+                             std::to_string(lat + distribution(generator)));
+        }
+    }
+
+    pbnavitia::Request make(const Kind& kind) {
+        pbnavitia::Request request;
+        if (kind.api == "matrix") {
+            request.set_requested_api(pbnavitia::street_network_routing_matrix);
+            auto* sn_request = request.mutable_sn_routing_matrix();
+            for (size_t i = 0; i < kind.nb_origins; ++i) {
+                sn_request->add_origins()->set_place(pick_place());
+            }
+            for (size_t i = 0; i < kind.nb_destinations; ++i) {
+                sn_request->add_destinations()->set_place(pick_place());
+            }
+            sn_request->set_mode(kind.mode);
+            sn_request->set_max_duration(3600);
+            sn_request->set_speed(get_speed(kind.mode));
+            return request;
+        }
+        request.set_requested_api(pbnavitia::direct_path);
+        auto* dp_request = request.mutable_direct_path();
+        dp_request->mutable_origin()->set_place(pick_place());
+        dp_request->mutable_destination()->set_place(pick_place());
+        dp_request->set_datetime(1470241573);
+        auto* sn_params = dp_request->mutable_streetnetwork_params();
+        sn_params->set_origin_mode(kind.mode);
+        sn_params->set_walking_speed(1.12);
+        sn_params->set_bike_speed(4.1);
+        sn_params->set_car_speed(11.11);
+        sn_params->set_car_no_park_speed(11.11);
+        sn_params->set_bss_rent_duration(120);
+        sn_params->set_bss_return_duration(60);
+        sn_params->set_language("fr-FR");
+        sn_params->set_enable_instructions(true);
+        return request;
+    }
+
+    size_t pick_kind() {
+        return kind_distribution(generator);
+    }
+
+private:
+    // The places are drawn from a fixed set, so that the caches of asgard are hit as with real traffic
+    const std::string& pick_place() {
+        return places[std::uniform_int_distribution<size_t>(0, places.size() - 1)(generator)];
+    }
+
+    std::mt19937 generator;
+    std::discrete_distribution<size_t> kind_distribution;
+    std::vector<std::string> places;
+};
+
+struct Stats {
+    std::vector<double> latencies;
+    size_t nb_errors = 0;
+    size_t nb_timeouts = 0;
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto i = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[i];
+}
+
+void report(const std::string& name, Stats stats, double duration) {
+    auto& latencies = stats.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(28) << name << std::setw(10) << latencies.size() << std::setw(8) << stats.nb_errors
+              << std::setw(10) << stats.nb_timeouts
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << latencies.size() / duration
+              << std::setprecision(2)
+              << std::setw(10) << percentile(latencies, 0.5) * 1000
+              << std::setw(10) << percentile(latencies, 0.9) * 1000
+              << std::setw(10) << percentile(latencies, 0.99) * 1000
+              << std::setw(10) << percentile(latencies, 0.999) * 1000
+              << std::setw(10) << (latencies.empty() ? 0 : latencies.back() * 1000) << std::endl;
+}
+
+struct InFlight {
+    size_t kind;
+    Clock::time_point start;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    po::options_description desc("Load a running asgard with a mix of requests");
+    std::string socket_path;
+    std::string mix;
+    double lon = 0;
+    double lat = 0;
+    double spread = 0;
+    size_t nb_places = 0;
+    double rate = 0;
+    size_t concurrency = 0;
+    double duration = 0;
+    double timeout = 0;
+    unsigned int seed = 0;
+
+    // clang-format off
+    desc.add_options()
+            ("help", "Show this message")
+            ("socket,s", po::value<std::string>(&socket_path)->default_value("tcp://localhost:6000"), "zmq socket of asgard")
+            ("mix,m", po::value<std::string>(&mix)->default_value("matrix/walking/1x100=4,matrix/car/1x100=2,direct_path/walking=1,direct_path/bss=1"),
+             "comma separated api/mode[/NxM]=weight")
+            ("lon", po::value<double>(&lon)->default_value(2.3522), "longitude of the center")
+            ("lat", po::value<double>(&lat)->default_value(48.8566), "latitude of the center")
+            ("spread", po::value<double>(&spread)->default_value(0.05), "maximal distance to the center, in degrees")
+            ("places,p", po::value<size_t>(&nb_places)->default_value(10000), "number of distinct places used by the requests")
+            ("rate,r", po::value<double>(&rate)->default_value(0), "open loop: requests sent per second whatever the responses, 0 for a closed loop")
+            ("concurrency,j", po::value<size_t>(&concurrency)->default_value(4), "closed loop: number of requests in flight")
+            ("duration,d", po::value<double>(&duration)->default_value(30), "duration of the load, in seconds")
+            ("timeout", po::value<double>(&timeout)->default_value(10), "seconds after which a request is given up")
+            ("seed", po::value<unsigned int>(&seed)->default_value(42), "seed of the random requests");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    std::vector<Kind> kinds;
+    try {
+        std::vector<std::string> specs;
+        boost::split(specs, mix, boost::is_any_of(","));
+        for (const auto& spec : specs) {
+            kinds.push_back(parse_kind(spec));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (nb_places == 0 || (rate <= 0 && concurrency == 0)) {
+        std::cerr << "at least 1 place and a rate or a concurrency are needed" << std::endl;
+        return 1;
+    }
+
+    RequestMaker request_maker(kinds, lon, lat, spread, nb_places, seed);
+    zmq::context_t zmq_context(1);
+    zmq::socket_t socket(zmq_context, ZMQ_DEALER);
+    // don't wait for asgard at exit to deliver the requests given up
+    socket.setsockopt(ZMQ_LINGER, 0);
+    socket.connect(socket_path);
+
+    std::unordered_map<uint64_t, InFlight> in_flight;
+    std::vector<Stats> stats(kinds.size());
+    uint64_t nb_sent = 0;
+    size_t nb_late_replies = 0;
+
+    // In open loop, the latency starts at the time the request should have been sent,
+    // so a client falling behind doesn't hide the slowness of asgard
+    auto send = [&](Clock::time_point start) {
+        const auto kind = request_maker.pick_kind();
+        const auto request = request_maker.make(kinds[kind]);
+        const auto seq = nb_sent++;
+        zmq::message_t seq_frame(sizeof(seq));
+        std::memcpy(seq_frame.data(), &seq, sizeof(seq));
+        zmq::message_t request_frame(request.ByteSizeLong());
+        request.SerializeWithCachedSizesToArray(static_cast<google::protobuf::uint8*>(request_frame.data()));
+        socket.send(seq_frame, ZMQ_SNDMORE);
+        socket.send(request_frame);
+        in_flight.emplace(seq, InFlight{kind, start});
+    };
+
+    // Return false when no reply is waiting
+    auto receive = [&]() {
+        zmq::message_t seq_frame;
+        if (!socket.recv(&seq_frame, ZMQ_DONTWAIT)) {
+            return false;
+        }
+        zmq::message_t response_frame;
+        socket.recv(&response_frame);
+        uint64_t seq = 0;
+        if (seq_frame.size() == sizeof(seq)) {
+            std::memcpy(&seq, seq_frame.data(), sizeof(seq));
+        }
+        const auto it = in_flight.find(seq);
+        if (it == in_flight.end()) {
+            // a request given up
+            ++nb_late_replies;
+            return true;
+        }
+        pbnavitia::Response response;
+        const bool is_error = !response.ParseFromArray(response_frame.data(), response_frame.size()) || response.has_error();
+        auto& kind_stats = stats[it->second.kind];
+        kind_stats.latencies.push_back(std::chrono::duration<double>(Clock::now() - it->second.start).count());
+        kind_stats.nb_errors += is_error;
+        in_flight.erase(it);
+        return true;
+    };
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    const auto timeout_duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+    auto next_send = start;
+    while (true) {
+        auto now = Clock::now();
+        if (now < end) {
+            if (rate > 0) {
+                while (next_send <= now && next_send < end) {
+                    send(next_send);
+                    next_send = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(nb_sent / rate));
+                }
+            } else {
+                while (in_flight.size() < concurrency) {
+                    send(now);
+                }
+            }
+        } else if (in_flight.empty()) {
+            break;
+        }
+
+        for (auto it = in_flight.begin(); it != in_flight.end();) {
+            if (now - it->second.start > timeout_duration) {
+                ++stats[it->second.kind].nb_timeouts;
+                it = in_flight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // Wake up for the next request to send in open loop, and regularly to give up the late requests
+        auto wait = std::chrono::milliseconds(10);
+        if (rate > 0 && now < end) {
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(next_send - now));
+        }
+        zmq::pollitem_t items[] = {{static_cast<void*>(socket), 0, ZMQ_POLLIN, 0}};
+        zmq::poll(items, 1, std::max<long>(wait.count(), 0));
+        while (receive()) {
+            if (rate <= 0 && Clock::now() < end) {
+                send(Clock::now());
+            }
+        }
+    }
+    const auto load_duration = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Stats all;
+    for (const auto& s : stats) {
+        all.latencies.insert(all.latencies.end(), s.latencies.begin(), s.latencies.end());
+        all.nb_errors += s.nb_errors;
+        all.nb_timeouts += s.nb_timeouts;
+    }
+
+    std::cout << nb_sent << " requests sent to " << socket_path << " in " << load_duration << "s, "
+              << (rate > 0 ? "open loop at " + std::to_string(rate) + " req/s" : "closed loop with " + std::to_string(concurrency) + " in flight")
+              << std::endl;
+    std::cout << std::setw(28) << "api/mode" << std::setw(10) << "requests" << std::setw(8) << "errors"
+              << std::setw(10) << "timeouts" << std::setw(12) << "req/s" << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p999 ms"
+              << std::setw(10) << "max ms" << std::endl;
+    for (size_t i = 0; i < kinds.size(); ++i) {
+        report(kinds[i].name, stats[i], load_duration);
+    }
+    report("total", all, load_duration);
+    if (nb_late_replies > 0) {
+        std::cout << nb_late_replies << " replies to requests given up" << std::endl;
+    }
+    return 0;
+}
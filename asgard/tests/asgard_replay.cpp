@@ -0,0 +1,190 @@
+#include "utils/zmq.h"
+#include "asgard/context.h"
+#include "asgard/handler.h"
+#include "asgard/metrics.h"
+#include "asgard/mode_costing.h"
+#include "asgard/projector.h"
+#include "asgard/request.pb.h"
+#include "asgard/request_capture.h"
+#include "asgard/thread_pool.h"
+
+#include <valhalla/baldr/graphreader.h>
+
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Replay the requests captured by asgard (see ASGARD_CAPTURE_PATH) against the handler, in process.
+// The latencies are the durations of Handler::handle, so they don't include zmq nor the serialization.
+
+namespace po = boost::program_options;
+using namespace asgard;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Replayed {
+    std::string name;
+    double latency;
+    bool error;
+};
+
+std::string get_name(const pbnavitia::Request& request) {
+    switch (request.requested_api()) {
+    case pbnavitia::street_network_routing_matrix:
+        return "matrix/" + request.sn_routing_matrix().mode();
+    case pbnavitia::direct_path:
+        return "direct_path/" + request.direct_path().streetnetwork_params().origin_mode();
+    default:
+        return "other";
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto i = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[i];
+}
+
+void report(const std::string& name, std::vector<double> latencies, size_t nb_errors, double duration) {
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(24) << name << std::setw(10) << latencies.size() << std::setw(8) << nb_errors
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << latencies.size() / duration
+              << std::setprecision(2)
+              << std::setw(10) << percentile(latencies, 0.5) * 1000
+              << std::setw(10) << percentile(latencies, 0.9) * 1000
+              << std::setw(10) << percentile(latencies, 0.99) * 1000
+              << std::setw(10) << (latencies.empty() ? 0 : latencies.back() * 1000) << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    po::options_description desc("Replay the requests captured by asgard");
+    std::string capture_path;
+    std::string conf_path;
+    size_t concurrency = 0;
+    double rate = 0;
+    size_t repeat = 0;
+    size_t cache_size = 0;
+    size_t nb_matrix_threads = 0;
+    size_t matrix_chunk_size = 0;
+
+    // clang-format off
+    desc.add_options()
+            ("help", "Show this message")
+            ("capture", po::value<std::string>(&capture_path)->required(), "file recorded with ASGARD_CAPTURE_PATH")
+            ("conf_path,c", po::value<std::string>(&conf_path)->required(), "valhalla configuration")
+            ("concurrency,j", po::value<size_t>(&concurrency)->default_value(3), "number of workers")
+            ("rate,r", po::value<double>(&rate)->default_value(0), "requests per second for all the workers, 0 to replay as fast as possible")
+            ("repeat", po::value<size_t>(&repeat)->default_value(1), "number of times the capture is replayed")
+            ("cache_size", po::value<size_t>(&cache_size)->default_value(1000000), "projector cache size")
+            ("matrix_threads", po::value<size_t>(&nb_matrix_threads)->default_value(0), "helper threads computing the chunks of matrices")
+            ("matrix_chunk_size", po::value<size_t>(&matrix_chunk_size)->default_value(500), "size of the chunks of matrices");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    const auto captured = read_captured_requests(capture_path);
+    std::vector<pbnavitia::Request> requests;
+    for (const auto& c : captured) {
+        pbnavitia::Request request;
+        if (request.ParseFromString(c)) {
+            requests.push_back(std::move(request));
+        }
+    }
+    std::cout << requests.size() << " requests read from " << capture_path << std::endl;
+    if (requests.empty()) {
+        return 1;
+    }
+
+    boost::property_tree::ptree conf;
+    boost::property_tree::read_json(conf_path, conf);
+    const auto reachability = conf.get<unsigned int>("loki.service_defaults.minimum_reachability", 0);
+    const auto radius = conf.get<unsigned int>("loki.service_defaults.radius", 0);
+
+    zmq::context_t zmq_context(1);
+    const Metrics metrics{boost::none};
+    const Projector projector(cache_size, reachability, reachability, radius);
+    valhalla::baldr::GraphReader graph(conf.get_child("mjolnir"));
+    ThreadPool thread_pool(nb_matrix_threads);
+    ContextOptions options;
+    options.thread_pool = &thread_pool;
+    options.matrix_chunk_size = matrix_chunk_size;
+    options.costing_cache_size = default_costing_cache_size;
+    const Context context(zmq_context, graph, metrics, projector, options);
+
+    const auto nb_requests = requests.size() * repeat;
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::vector<Replayed> replayed;
+    replayed.reserve(nb_requests);
+
+    const auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < concurrency; ++i) {
+        workers.emplace_back([&]() {
+            Handler handler(context);
+            std::vector<Replayed> local;
+            for (auto n = next++; n < nb_requests; n = next++) {
+                if (rate > 0) {
+                    // each request has its own slot, so a slow request doesn't lower the rate
+                    std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(n / rate)));
+                }
+                const auto& request = requests[n % requests.size()];
+                const auto before = Clock::now();
+                const auto response = handler.handle(request);
+                const auto latency = std::chrono::duration<double>(Clock::now() - before).count();
+                local.push_back({get_name(request), latency, response.has_error()});
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            replayed.insert(replayed.end(), local.begin(), local.end());
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    const auto duration = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::map<std::string, std::pair<std::vector<double>, size_t>> by_name;
+    std::vector<double> all;
+    size_t nb_errors = 0;
+    for (const auto& r : replayed) {
+        auto& stats = by_name[r.name];
+        stats.first.push_back(r.latency);
+        stats.second += r.error;
+        all.push_back(r.latency);
+        nb_errors += r.error;
+    }
+
+    std::cout << std::endl
+              << nb_requests << " requests replayed in " << duration << "s on " << concurrency << " workers" << std::endl;
+    std::cout << std::setw(24) << "api/mode" << std::setw(10) << "requests" << std::setw(8) << "errors"
+              << std::setw(12) << "req/s" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+    for (const auto& stats : by_name) {
+        report(stats.first, stats.second.first, stats.second.second, duration);
+    }
+    report("total", all, nb_errors, duration);
+    std::cout << "projector cache: " << projector.get_nb_cache_miss() << " misses for "
+              << projector.get_nb_cache_calls() << " calls" << std::endl;
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "utils/zmq.h"
+#include "asgard/context.h"
+#include "asgard/handler.h"
+#include "asgard/metrics.h"
+#include "asgard/projector.h"
+#include "asgard/request.pb.h"
+
+#include <valhalla/baldr/graphreader.h>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// Compare the latency of direct paths with and without instructions, for each mode
+
+namespace po = boost::program_options;
+using namespace asgard;
+
+namespace {
+
+pbnavitia::Request make_request(const std::string& origin, const std::string& destination, const std::string& mode, bool enable_instructions) {
+    pbnavitia::Request request;
+    request.set_requested_api(pbnavitia::direct_path);
+    auto* dp_request = request.mutable_direct_path();
+    dp_request->mutable_origin()->set_place(origin);
+    dp_request->mutable_destination()->set_place(destination);
+    auto* sn_params = dp_request->mutable_streetnetwork_params();
+    sn_params->set_origin_mode(mode);
+    sn_params->set_walking_speed(1.12);
+    sn_params->set_bike_speed(4.1);
+    sn_params->set_car_speed(11.11);
+    sn_params->set_car_no_park_speed(11.11);
+    sn_params->set_bss_rent_duration(120);
+    sn_params->set_bss_return_duration(60);
+    sn_params->set_language("fr-FR");
+    sn_params->set_enable_instructions(enable_instructions);
+    return request;
+}
+
+// Return the median duration in ms
+double run(Handler& handler, const pbnavitia::Request& request, size_t nb_iterations) {
+    std::vector<double> durations;
+    for (size_t i = 0; i < nb_iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto response = handler.handle(request);
+        durations.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(durations.begin(), durations.end());
+    return durations[durations.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    po::options_description desc("Benchmark of direct paths with and without instructions");
+    std::string conf_path;
+    std::string origin;
+    std::string destination;
+    std::string modes;
+    size_t nb_iterations = 0;
+
+    // clang-format off
+    desc.add_options()
+            ("help", "Show this message")
+            ("conf_path,c", po::value<std::string>(&conf_path)->required(), "valhalla configuration")
+            ("origin", po::value<std::string>(&origin)->default_value("coord:2.377310:48.847002"), "origin")
+            ("destination", po::value<std::string>(&destination)->default_value("coord:2.339853:48.883017"), "destination")
+            ("modes", po::value<std::string>(&modes)->default_value("walking,bike,car,taxi,bss"), "comma separated modes")
+            ("iterations,n", po::value<size_t>(&nb_iterations)->default_value(50), "number of requests per mode");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    boost::property_tree::ptree conf;
+    boost::property_tree::read_json(conf_path, conf);
+
+    zmq::context_t zmq_context(1);
+    const Metrics metrics{boost::none};
+    const Projector projector(1000);
+    valhalla::baldr::GraphReader graph(conf.get_child("mjolnir"));
+    const Context context(zmq_context, graph, metrics, projector);
+    Handler handler(context);
+
+    std::vector<std::string> list_modes;
+    boost::split(list_modes, modes, boost::is_any_of(","));
+
+    std::cout << std::setw(10) << "mode" << std::setw(22) << "instructions (ms)" << std::setw(22)
+              << "no instructions (ms)" << std::setw(10) << "saved" << std::endl;
+    for (const auto& mode : list_modes) {
+        const auto with_instructions = make_request(origin, destination, mode, true);
+        const auto without_instructions = make_request(origin, destination, mode, false);
+        // warm the tiles up
+        handler.handle(with_instructions);
+
+        const auto with_duration = run(handler, with_instructions, nb_iterations);
+        const auto without_duration = run(handler, without_instructions, nb_iterations);
+        std::cout << std::setw(10) << mode << std::fixed << std::setprecision(3)
+                  << std::setw(22) << with_duration
+                  << std::setw(22) << without_duration
+                  << std::setw(9) << std::setprecision(1) << 100 * (1 - without_duration / with_duration) << "%" << std::endl;
+    }
+}
@@ -0,0 +1,252 @@
+#include "asgard/allocation_counter.h"
+#include "asgard/direct_path_response_builder.h"
+#include "asgard/request.pb.h"
+
+#include <valhalla/midgard/encoded.h>
+#include <valhalla/midgard/pointll.h>
+#include <valhalla/proto/trip.pb.h>
+#include <valhalla/thor/pathinfo.h>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// Time the conversion of synthetic valhalla directions to a navitia journey, end to end and per helper,
+// for each mode. The allocations are counted by the global operator new of allocation_counter.cpp
+
+namespace po = boost::program_options;
+using namespace asgard;
+using namespace asgard::direct_path_response_builder;
+using namespace valhalla;
+
+namespace {
+
+constexpr time_t DATETIME = 1470241573;
+
+struct SyntheticPath {
+    pbnavitia::Request request;
+    valhalla::Api api;
+    std::vector<thor::PathInfo> pathedges;
+    std::vector<midgard::PointLL> shape;
+    // Only for bss, the maneuvers where the bike is rented and returned
+    int rent_index = -1;
+    int return_index = -1;
+};
+
+DirectionsLeg_TravelMode get_travel_mode(const std::string& mode) {
+    if (mode == "bike") {
+        return DirectionsLeg_TravelMode::DirectionsLeg_TravelMode_kBicycle;
+    }
+    if (mode == "car" || mode == "taxi") {
+        return DirectionsLeg_TravelMode::DirectionsLeg_TravelMode_kDrive;
+    }
+    return DirectionsLeg_TravelMode::DirectionsLeg_TravelMode_kPedestrian;
+}
+
+// A straight path of nb_maneuvers maneuvers with nb_points shape points each.
+// A bss path walks its first third, rides its second one and walks the rest
+void make_synthetic_path(SyntheticPath& path,
+                         const std::string& mode,
+                         size_t nb_maneuvers,
+                         size_t nb_points,
+                         bool enable_instructions) {
+    auto* dp = path.request.mutable_direct_path();
+    dp->set_datetime(DATETIME);
+    auto* params = dp->mutable_streetnetwork_params();
+    params->set_origin_mode(mode);
+    params->set_bss_rent_duration(120);
+    params->set_bss_return_duration(60);
+    params->set_enable_instructions(enable_instructions);
+
+    if (mode == "bss") {
+        path.rent_index = static_cast<int>(nb_maneuvers / 3);
+        path.return_index = static_cast<int>(2 * nb_maneuvers / 3);
+    }
+
+    for (size_t i = 0; i <= nb_maneuvers * nb_points; ++i) {
+        path.shape.emplace_back(2.35 + i * 0.0001, 48.85 + (i % 2) * 0.00005);
+    }
+
+    auto* trip_leg = path.api.mutable_trip()->mutable_routes()->Add()->mutable_legs()->Add();
+    trip_leg->mutable_location()->Add();
+    trip_leg->mutable_location()->Add();
+    trip_leg->mutable_admin()->Add();
+    trip_leg->set_shape(midgard::encode(path.shape));
+
+    auto* directions_leg = path.api.mutable_directions()->mutable_routes()->Add()->mutable_legs()->Add();
+    uint32_t elapsed = 0;
+    float length = 0;
+    for (size_t i = 0; i < nb_maneuvers; ++i) {
+        const int index = static_cast<int>(i);
+        const bool on_bike = index >= path.rent_index && index < path.return_index;
+        const auto maneuver_length = nb_points * 0.0075f;
+        auto maneuver_time = static_cast<uint32_t>(maneuver_length * 1000 / (on_bike ? 4.1 : 1.12));
+        // as with valhalla, renting and returning the bike are part of the time of their maneuvers
+        if (index == path.rent_index) {
+            maneuver_time += params->bss_rent_duration();
+        } else if (index == path.return_index) {
+            maneuver_time += params->bss_return_duration();
+        }
+
+        trip_leg->add_node()->mutable_edge()->set_length_km(maneuver_length);
+
+        auto* maneuver = directions_leg->add_maneuver();
+        maneuver->set_begin_shape_index(i * nb_points);
+        maneuver->set_end_shape_index((i + 1) * nb_points);
+        maneuver->set_begin_path_index(i);
+        maneuver->set_end_path_index(i + 1);
+        maneuver->set_length(maneuver_length);
+        maneuver->set_time(maneuver_time);
+        maneuver->set_turn_degree((i * 90) % 360);
+        maneuver->mutable_street_name()->Add()->set_value("Rue " + std::to_string(i));
+        maneuver->set_text_instruction("Turn onto Rue " + std::to_string(i) + ".");
+        if (mode == "bss") {
+            maneuver->set_travel_mode(on_bike ? DirectionsLeg_TravelMode::DirectionsLeg_TravelMode_kBicycle
+                                              : DirectionsLeg_TravelMode::DirectionsLeg_TravelMode_kPedestrian);
+        } else {
+            maneuver->set_travel_mode(get_travel_mode(mode));
+        }
+        if (index == path.rent_index) {
+            maneuver->set_bss_maneuver_type(DirectionsLeg_Maneuver_BssManeuverType_kRentBikeAtBikeShare);
+        } else if (index == path.return_index) {
+            maneuver->set_bss_maneuver_type(DirectionsLeg_Maneuver_BssManeuverType_kReturnBikeAtBikeShare);
+        }
+
+        elapsed += maneuver_time;
+        length += maneuver_length * 1000;
+        path.pathedges.emplace_back(sif::TravelMode::kPedestrian, sif::Cost(elapsed, elapsed), baldr::GraphId(), 0, length);
+    }
+    // the last node has no maneuver
+    trip_leg->add_node();
+}
+
+struct Measure {
+    double duration;
+    double nb_allocations;
+};
+
+// Return the median duration in ns and the mean number of allocations of f,
+// including the ones of the messages it builds and destroys
+template<typename F>
+Measure run(F&& f, size_t nb_iterations) {
+    std::vector<double> durations;
+    size_t nb_allocations = 0;
+    for (size_t i = 0; i < nb_iterations; ++i) {
+        const auto allocations_before = allocation_counter::get_nb_allocations();
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        durations.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+        nb_allocations += allocation_counter::get_nb_allocations() - allocations_before;
+    }
+    std::sort(durations.begin(), durations.end());
+    return {durations[durations.size() / 2], static_cast<double>(nb_allocations) / nb_iterations};
+}
+
+void report(const std::string& mode, const std::string& step, const Measure& measure, const SyntheticPath& path) {
+    const auto nb_maneuvers = path.api.directions().routes(0).legs(0).maneuver_size();
+    std::cout << std::setw(8) << mode << std::setw(26) << step << std::fixed << std::setprecision(0)
+              << std::setw(12) << measure.duration
+              << std::setprecision(1)
+              << std::setw(14) << measure.duration / nb_maneuvers
+              << std::setw(12) << measure.duration / path.shape.size()
+              << std::setw(10) << measure.nb_allocations << std::endl;
+}
+
+void benchmark(const std::string& mode, size_t nb_maneuvers, size_t nb_points, bool enable_instructions, size_t nb_iterations) {
+    SyntheticPath path;
+    make_synthetic_path(path, mode, nb_maneuvers, nb_points, enable_instructions);
+    const auto& trip_leg = path.api.trip().routes(0).legs(0);
+    const auto& directions_leg = path.api.directions().routes(0).legs(0);
+    const auto& params = path.request.direct_path().streetnetwork_params();
+
+    report(mode, "build_journey_response", run([&]() {
+               pbnavitia::Response response;
+               build_journey_response(path.request, path.pathedges, trip_leg, path.api, response);
+           }, nb_iterations), path);
+    report(mode, "decode shape", run([&]() {
+               midgard::decode<std::vector<midgard::PointLL>>(trip_leg.shape());
+           }, nb_iterations), path);
+    report(mode, "compute_geojson", run([&]() {
+               pbnavitia::Section section;
+               compute_geojson(path.shape, section);
+           }, nb_iterations), path);
+    report(mode, "compute_path_items", run([&]() {
+               pbnavitia::StreetNetwork sn;
+               compute_path_items(path.api, &sn, enable_instructions,
+                                  directions_leg.maneuver().begin(), directions_leg.maneuver().end());
+           }, nb_iterations), path);
+    report(mode, "set_extremity_pt_object", run([&]() {
+               pbnavitia::PtObject pt_object;
+               set_extremity_pt_object(path.shape.front(), &pt_object);
+           }, nb_iterations), path);
+
+    if (mode != "bss") {
+        return;
+    }
+    const auto rent_maneuver = directions_leg.maneuver().begin() + path.rent_index;
+    const auto return_maneuver = directions_leg.maneuver().begin() + path.return_index;
+    report(mode, "make_bss_rent_section", run([&]() {
+               pbnavitia::Journey journey;
+               make_bss_rent_section(journey, path.api, directions_leg, path.shape, rent_maneuver,
+                                     DATETIME, params, 1, enable_instructions);
+           }, nb_iterations), path);
+    report(mode, "bss bike section", run([&]() {
+               pbnavitia::Journey journey;
+               make_bss_streetnetwork_section(journey, path.api, directions_leg, path.shape, rent_maneuver, return_maneuver,
+                                              DATETIME, params, 2, enable_instructions);
+           }, nb_iterations), path);
+    report(mode, "make_bss_return_section", run([&]() {
+               pbnavitia::Journey journey;
+               make_bss_return_section(journey, path.api, directions_leg, path.shape, return_maneuver,
+                                       DATETIME, params, 3, enable_instructions);
+           }, nb_iterations), path);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    po::options_description desc("Benchmark of the direct path response builder on synthetic paths");
+    std::string modes;
+    size_t nb_maneuvers = 0;
+    size_t nb_points = 0;
+    bool enable_instructions = true;
+    size_t nb_iterations = 0;
+
+    // clang-format off
+    desc.add_options()
+            ("help", "Show this message")
+            ("modes", po::value<std::string>(&modes)->default_value("walking,bike,car,taxi,bss"), "comma separated modes")
+            ("maneuvers,m", po::value<size_t>(&nb_maneuvers)->default_value(50), "number of maneuvers of the paths, at least 3")
+            ("points,p", po::value<size_t>(&nb_points)->default_value(10), "number of shape points per maneuver")
+            ("instructions", po::value<bool>(&enable_instructions)->default_value(true), "build the instructions")
+            ("iterations,n", po::value<size_t>(&nb_iterations)->default_value(1000), "number of runs per step");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+    if (nb_maneuvers < 3 || nb_points == 0 || nb_iterations == 0) {
+        std::cerr << "at least 3 maneuvers, 1 point per maneuver and 1 iteration are needed" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> list_modes;
+    boost::split(list_modes, modes, boost::is_any_of(","));
+
+    std::cout << nb_maneuvers << " maneuvers, " << nb_maneuvers * nb_points + 1 << " shape points" << std::endl;
+    std::cout << std::setw(8) << "mode" << std::setw(26) << "step" << std::setw(12) << "ns"
+              << std::setw(14) << "ns/maneuver" << std::setw(12) << "ns/point" << std::setw(10) << "allocs" << std::endl;
+    for (const auto& mode : list_modes) {
+        benchmark(mode, nb_maneuvers, nb_points, enable_instructions, nb_iterations);
+    }
+    return 0;
+}
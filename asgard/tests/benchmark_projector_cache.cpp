@@ -1,3 +1,4 @@
+#include "asgard/clock_cache.h"
 #include "asgard/mode_costing.h"
 #include "asgard/projector.h"
 
@@ -13,8 +14,13 @@
 #include <boost/range/algorithm/transform.hpp>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <list>
 #include <random>
 #include <thread>
+#include <unordered_map>
 
 namespace po = boost::program_options;
 using namespace valhalla::baldr;
@@ -22,7 +28,7 @@ using namespace asgard;
 using ListOfLocations = std::vector<std::vector<valhalla::midgard::PointLL>>;
 using ListOfResults = std::vector<std::unordered_map<valhalla::midgard::PointLL, PathLocation>>;
 
-void compute(const Projector& projector, boost::property_tree::ptree conf, boost::progress_display& show_progress, ListOfLocations list_of_locations) {
+void compute(const Projector& projector, boost::property_tree::ptree conf, boost::progress_display* show_progress, ListOfLocations list_of_locations) {
 
     for (auto& locations : list_of_locations) {
         std::random_shuffle(locations.begin(), locations.end());
@@ -32,7 +38,9 @@ void compute(const Projector& projector, boost::property_tree::ptree conf, boost
     auto costing = mode_costing.get_costing_for_mode("car");
     ListOfResults list_of_results;
     for (auto locations : list_of_locations) {
-        ++show_progress;
+        if (show_progress) {
+            ++(*show_progress);
+        }
         auto result = projector(begin(locations), end(locations), graph, "car", costing);
 
         std::this_thread::yield();
@@ -552,10 +560,226 @@ ListOfLocations build_list_of_locations(size_t nb_threads) {
     return list_of_locations;
 }
 
+ProjectorOptions make_options(size_t cache_size, size_t nb_shards) {
+    ProjectorOptions options;
+    options.cache_size = cache_size;
+    options.nb_shards = nb_shards;
+    return options;
+}
+
+// Run the workload on nb_threads threads sharing the same projector and return the elapsed seconds
+double run(const Projector& projector, const boost::property_tree::ptree& conf, size_t nb_threads, const ListOfLocations& l) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nb_threads; ++i) {
+        threads.emplace_back(compute, std::ref(projector), conf, nullptr, l);
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compare a single shard, ie. a single lock, with the sharded cache for 1, 2, 4... nb_threads threads
+void thread_scaling_report(size_t cache_size, size_t nb_shards, size_t nb_threads, const boost::property_tree::ptree& conf) {
+    // the projector may use less shards than requested for a small cache
+    const auto effective_nb_shards = Projector(make_options(cache_size, nb_shards)).get_nb_shards();
+    std::cout << std::endl
+              << "Thread scaling report (requests/s)" << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(16) << "1 shard" << std::setw(16)
+              << (std::to_string(effective_nb_shards) + " shards") << std::setw(10) << "speedup" << std::endl;
+    for (size_t t = 1; t <= nb_threads; t *= 2) {
+        const auto l = build_list_of_locations(t);
+        const double nb_requests = l.size() * t;
+        const Projector single_lock(make_options(cache_size, 1));
+        const Projector sharded(make_options(cache_size, nb_shards));
+        const auto single_lock_duration = run(single_lock, conf, t, l);
+        const auto sharded_duration = run(sharded, conf, t, l);
+        std::cout << std::setw(10) << t << std::fixed << std::setprecision(1)
+                  << std::setw(16) << nb_requests / single_lock_duration
+                  << std::setw(16) << nb_requests / sharded_duration
+                  << std::setw(9) << std::setprecision(2) << single_lock_duration / sharded_duration << "x" << std::endl;
+    }
+}
+
+// Compare the hit ratio of the exact keys with the one of a grid, on the locations moved by a few centimeters
+// at each request, like re-geocoded addresses or stop coordinates rounded differently
+void grid_report(size_t cache_size, double grid_cell_size, const boost::property_tree::ptree& conf) {
+    const size_t NB_REQUESTS = 20;
+
+    const auto locations = build_list_of_locations(1).front();
+    std::mt19937 generator(42);
+    // about 5cm
+    std::uniform_real_distribution<float> jitter(-0.0000005f, 0.0000005f);
+
+    valhalla::baldr::GraphReader graph(conf.get_child("mjolnir"));
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const Projector exact(cache_size);
+    auto grid_options = make_options(cache_size, 16);
+    grid_options.grid_cell_size = grid_cell_size;
+    const Projector grid(grid_options);
+    for (size_t i = 0; i < NB_REQUESTS; ++i) {
+        std::vector<valhalla::midgard::PointLL> jittered;
+        for (const auto& l : locations) {
+            jittered.emplace_back(l.lng() + jitter(generator), l.lat() + jitter(generator));
+        }
+        exact(begin(jittered), end(jittered), graph, "car", costing);
+        grid(begin(jittered), end(jittered), graph, "car", costing);
+    }
+
+    const auto hit_ratio = [](const Projector& p) {
+        return 100. * (p.get_nb_cache_calls() - p.get_nb_cache_miss()) / p.get_nb_cache_calls();
+    };
+    std::cout << std::endl
+              << "Grid report: " << locations.size() << " locations moved by up to 5cm at each of the "
+              << NB_REQUESTS << " requests" << std::endl;
+    std::cout << std::setw(16) << "keys" << std::setw(16) << "hit ratio" << std::setw(16) << "cache size" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(16) << "exact" << std::setw(15) << hit_ratio(exact) << "%" << std::setw(16) << exact.get_current_cache_size() << std::endl
+              << std::setw(16) << (std::to_string(grid_cell_size) + "m grid") << std::setw(15) << hit_ratio(grid) << "%"
+              << std::setw(16) << grid.get_current_cache_size() << std::endl;
+}
+
+// Compare the memory used by an entry of the packed cache with an estimate of the former one,
+// which kept the whole PathLocation in a std::unordered_map, and check the hits give back the searched projections
+void memory_report(const boost::property_tree::ptree& conf) {
+    const auto locations = build_list_of_locations(1).front();
+
+    valhalla::baldr::GraphReader graph(conf.get_child("mjolnir"));
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const Projector p(locations.size());
+    const auto searched = p(begin(locations), end(locations), graph, "car", costing, false);
+    p(begin(locations), end(locations), graph, "car", costing);
+    const auto cached = p(begin(locations), end(locations), graph, "car", costing);
+
+    using FormerKey = std::pair<valhalla::midgard::PointLL, std::string>;
+    // key and value of the entry, then the node of the index with its own copy of the key, and its bucket
+    const size_t former_fixed_size = sizeof(FormerKey) + sizeof(PathLocation) + sizeof(bool) +
+                                     2 * sizeof(void*) + sizeof(FormerKey) + 2 * sizeof(size_t);
+    size_t former_bytes = 0;
+    size_t nb_edges = 0;
+    size_t nb_different = 0;
+    for (const auto& l : searched) {
+        former_bytes += former_fixed_size + (l.second.edges.capacity() + l.second.filtered_edges.capacity()) * sizeof(PathLocation::PathEdge);
+        nb_edges += l.second.edges.size() + l.second.filtered_edges.size();
+        const auto& edges = cached.at(l.first).edges;
+        const bool same = edges.size() == l.second.edges.size() &&
+                          std::equal(edges.begin(), edges.end(), l.second.edges.begin(), [](const auto& a, const auto& b) {
+                              return a.id == b.id && a.percent_along == b.percent_along && a.distance == b.distance;
+                          });
+        nb_different += !same;
+    }
+
+    const auto nb_entries = p.get_current_cache_size();
+    std::cout << std::endl
+              << "Memory report: " << nb_entries << " cached projections, "
+              << std::setprecision(2) << std::fixed << double(nb_edges) / std::max<size_t>(1, searched.size()) << " edges per projection" << std::endl;
+    std::cout << std::setw(24) << "entries" << std::setw(20) << "bytes per entry" << std::endl;
+    std::cout << std::setprecision(1)
+              << std::setw(24) << "PathLocation (estimate)" << std::setw(20) << double(former_bytes) / std::max<size_t>(1, searched.size()) << std::endl
+              << std::setw(24) << "packed" << std::setw(20) << double(p.get_cache_memory_usage()) / std::max<size_t>(1, nb_entries) << std::endl;
+    std::cout << nb_different << " cached projections differ from the searched ones" << std::endl;
+}
+
+// Exact LRU, the reference the CLOCK cache approximates
+class LruCache {
+    size_t capacity;
+    std::list<uint64_t> keys;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> index;
+
+public:
+    explicit LruCache(size_t capacity) : capacity(capacity) {}
+
+    // Return whether key was cached, and cache it
+    bool access(uint64_t key) {
+        const auto search = index.find(key);
+        if (search != index.end()) {
+            keys.splice(keys.begin(), keys, search->second);
+            return true;
+        }
+        if (keys.size() >= capacity) {
+            index.erase(keys.back());
+            keys.pop_back();
+        }
+        keys.push_front(key);
+        index.emplace(key, keys.begin());
+        return false;
+    }
+};
+
+struct Mix64 {
+    size_t operator()(uint64_t key) const {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+// Compare the hit ratios of LRU, CLOCK and CLOCK with the frequency admission on a Zipfian workload of
+// places, interrupted by matrices whose targets are only seen once, like the ones of one-off addresses
+void zipf_report(size_t cache_size, size_t nb_shards) {
+    const size_t NB_PLACES = 100 * cache_size;
+    const size_t NB_REQUESTS = 200 * cache_size;
+    const double EXPONENT = 0.9;
+    const size_t SCAN_PERIOD = 10 * cache_size;
+    const size_t SCAN_SIZE = cache_size;
+
+    std::vector<double> cdf(NB_PLACES);
+    double sum = 0;
+    for (size_t i = 0; i < NB_PLACES; ++i) {
+        sum += 1 / std::pow(i + 1, EXPONENT);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<uint64_t> workload;
+    workload.reserve(NB_REQUESTS);
+    uint64_t next_cold_place = NB_PLACES;
+    for (size_t i = 0; i < NB_REQUESTS; ++i) {
+        if (i % SCAN_PERIOD < SCAN_SIZE) {
+            workload.push_back(next_cold_place++);
+        } else {
+            workload.push_back(std::lower_bound(cdf.begin(), cdf.end(), uniform(generator)) - cdf.begin());
+        }
+    }
+
+    LruCache lru(cache_size);
+    ClockCache<uint64_t, bool, Mix64> clock(cache_size, nb_shards);
+    ClockCache<uint64_t, bool, Mix64> admission(cache_size, nb_shards, 64, 0, true);
+    size_t lru_hits = 0;
+    size_t clock_hits = 0;
+    size_t admission_hits = 0;
+    for (const auto key : workload) {
+        lru_hits += lru.access(key);
+        for (auto* cache : {&clock, &admission}) {
+            if (cache->find(key, [](bool) {})) {
+                (cache == &clock ? clock_hits : admission_hits) += 1;
+            } else {
+                cache->insert(key, true);
+            }
+        }
+    }
+
+    std::cout << std::endl
+              << "Zipf report: " << NB_REQUESTS << " lookups of " << NB_PLACES << " places (s = " << EXPONENT
+              << "), with " << SCAN_SIZE << " places seen once every " << SCAN_PERIOD << " lookups" << std::endl;
+    std::cout << std::setw(24) << "cache" << std::setw(16) << "hit ratio" << std::endl;
+    std::cout << std::fixed << std::setprecision(2)
+              << std::setw(24) << "LRU" << std::setw(15) << 100. * lru_hits / NB_REQUESTS << "%" << std::endl
+              << std::setw(24) << "CLOCK" << std::setw(15) << 100. * clock_hits / NB_REQUESTS << "%" << std::endl
+              << std::setw(24) << "CLOCK + admission" << std::setw(15) << 100. * admission_hits / NB_REQUESTS << "%"
+              << "  (" << admission.get_nb_rejected() << " rejected)" << std::endl;
+}
+
 int main(int argc, char** argv) {
     po::options_description desc("Options de l'outil de benchmark");
     size_t cache_size = 0;
     size_t nb_threads = 0;
+    size_t nb_shards = 0;
+    double grid_cell_size = 0;
     std::string conf_path = "";
 
     // clang-format off
@@ -563,6 +787,11 @@ int main(int argc, char** argv) {
             ("help", "Show this message")
             ("size,s", po::value<size_t>(&cache_size)->default_value(10), "cache size")
             ("threads,t", po::value<size_t>(&nb_threads)->default_value(3), "number of threads to run")
+            ("shards", po::value<size_t>(&nb_shards)->default_value(16), "number of shards of the cache")
+            ("scaling", "report the throughput of a single lock vs a sharded cache from 1 to <threads> threads")
+            ("grid", po::value<double>(&grid_cell_size)->default_value(0), "report the hit ratio of a grid of this cell size in meters vs exact keys")
+            ("memory", "report the memory used by an entry of the cache")
+            ("zipf", "report the hit ratio of the frequency admission vs LRU on a Zipfian workload with scans")
             ("conf_path,c", po::value<std::string>(&conf_path)->default_value(""), "conf_path");
     // clang-format on
 
@@ -573,18 +802,19 @@ int main(int argc, char** argv) {
     auto l = build_list_of_locations(nb_threads);
     std::cout << "cache_size = " << cache_size << std::endl;
     std::cout << "nb_threads = " << nb_threads << std::endl;
+    std::cout << "nb_shards = " << nb_shards << std::endl;
     std::cout << "conf_path = " << conf_path << std::endl;
 
     boost::property_tree::ptree conf;
     boost::property_tree::read_json(conf_path, conf);
-    Projector p(cache_size);
+    Projector p(make_options(cache_size, nb_shards));
     boost::progress_display show_progress(l.size() * nb_threads);
     {
         Timer t("Projector cache ");
         std::vector<std::thread> threads;
 
         for (size_t i = 0; i < nb_threads; ++i) {
-            auto t = std::thread(compute, std::ref(p), conf, std::ref(show_progress), l);
+            auto t = std::thread(compute, std::ref(p), conf, &show_progress, l);
             threads.push_back(std::move(t));
         }
         for (auto& th : threads) {
@@ -593,4 +823,20 @@ int main(int argc, char** argv) {
     }
 
     std::cout << "Number of requests: " << l.size() << std::endl;
+
+    if (vm.count("scaling")) {
+        thread_scaling_report(cache_size, nb_shards, nb_threads, conf);
+    }
+
+    if (grid_cell_size > 0) {
+        grid_report(std::max<size_t>(cache_size, 10000), grid_cell_size, conf);
+    }
+
+    if (vm.count("memory")) {
+        memory_report(conf);
+    }
+
+    if (vm.count("zipf")) {
+        zipf_report(std::max<size_t>(cache_size, 1000), nb_shards);
+    }
 }
@@ -10,11 +10,16 @@
 #include "asgard/metrics.h"
 #include "asgard/projector.h"
 #include "asgard/request.pb.h"
+#include "asgard/thread_pool.h"
+#include "asgard/util.h"
 
 #include <valhalla/midgard/pointll.h>
 
+#include <google/protobuf/arena.h>
 #include <boost/test/unit_test.hpp>
 
+#include <tuple>
+
 using namespace valhalla;
 
 namespace asgard {
@@ -39,6 +44,49 @@ void add_origin_or_dest_to_request(pbnavitia::LocationContext* location, const s
     location->set_access_duration(0);
 }
 
+// The graph of the test tile, and what the handlers of a test case share
+struct HandlerFixture : tile_maker::GraphFixture {
+    zmq::context_t zmq_context{1};
+    const Metrics metrics{boost::none};
+    const Projector projector{10, 0, 0};
+};
+
+class UnitTestHandler {
+public:
+    explicit UnitTestHandler(const Context& context) : h(context) {}
+
+    pbnavitia::Response handle(const pbnavitia::Request& request) { return h.handle(request); }
+    void handle(const pbnavitia::Request& request, pbnavitia::Response& response, const Handler::MatrixChunkCallback& on_matrix_chunk) {
+        h.handle(request, response, on_matrix_chunk);
+    }
+
+    // The matrix between the given points, walking at 2 m/s
+    std::vector<valhalla::thor::TimeDistance> compute_matrix(const std::vector<midgard::PointLL>& sources,
+                                                             const std::vector<midgard::PointLL>& targets) {
+        ModeCostingArgs args;
+        args.mode = "walking";
+        args.speeds[util::convert_navitia_to_valhalla_costing("walking")] = 2;
+        h.mode_costing.update_costing(args);
+        return h.compute_matrix(to_valhalla_locations(sources), to_valhalla_locations(targets), "walking", 100000);
+    }
+
+    size_t get_nb_matrix_searches() const { return h.nb_matrix_searches; }
+    size_t get_nb_matrix_routed_locations() const { return h.nb_matrix_routed_locations; }
+
+private:
+    google::protobuf::RepeatedPtrField<valhalla::Location> to_valhalla_locations(const std::vector<midgard::PointLL>& points) {
+        const auto costing = h.mode_costing.get_costing_for_mode("walking");
+        const auto projected = h.projector(points.begin(), points.end(), h.graph, "walking", costing);
+        google::protobuf::RepeatedPtrField<valhalla::Location> locations;
+        for (const auto& p : points) {
+            baldr::PathLocation::toPBF(projected.at(p), locations.Add(), h.graph);
+        }
+        return locations;
+    }
+
+    Handler h;
+};
+
 BOOST_AUTO_TEST_CASE(handle_matrix_test) {
     tile_maker::TileMaker maker;
     maker.make_tile();
@@ -83,6 +131,354 @@ BOOST_AUTO_TEST_CASE(handle_matrix_test) {
     BOOST_CHECK_EQUAL(expected_response.DebugString(), response.DebugString());
 }
 
+BOOST_FIXTURE_TEST_CASE(handle_matrix_with_cache_test, HandlerFixture) {
+    MatrixCache matrix_cache{100, 1};
+    ContextOptions options;
+    options.matrix_cache = &matrix_cache;
+    Context c{zmq_context, graph, metrics, projector, options};
+
+    Handler h{c};
+
+    const auto make_request = [&](size_t nb_destinations, float speed) {
+        pbnavitia::Request request;
+        request.set_requested_api(pbnavitia::street_network_routing_matrix);
+        auto* sn_request = request.mutable_sn_routing_matrix();
+        add_origin_or_dest_to_request(sn_request->add_origins(),
+                                      make_string_from_point(maker.get_all_points().front()));
+        for (size_t i = 0; i < nb_destinations; ++i) {
+            add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(maker.get_all_points().at(i)));
+        }
+        sn_request->set_mode("walking");
+        sn_request->set_max_duration(100000);
+        sn_request->set_speed(speed);
+        return request;
+    };
+
+    const std::vector<unsigned int> expected_times = {0, 111, 444, 667, 359, 568};
+
+    // Only the 3 first targets are computed and cached
+    h.handle(make_request(3, 2));
+    BOOST_CHECK_EQUAL(matrix_cache.size(), 3);
+
+    // The 3 first targets come from the cache, the others are computed
+    const auto response = h.handle(make_request(expected_times.size(), 2));
+    BOOST_CHECK_EQUAL(matrix_cache.size(), expected_times.size());
+    const auto& row = response.sn_routing_matrix().rows(0);
+    BOOST_REQUIRE_EQUAL(row.routing_response_size(), expected_times.size());
+    for (size_t i = 0; i < expected_times.size(); ++i) {
+        BOOST_CHECK_EQUAL(row.routing_response(i).duration(), expected_times[i]);
+        BOOST_CHECK_EQUAL(row.routing_response(i).routing_status(), pbnavitia::RoutingStatus::reached);
+    }
+
+    // Another speed is another costing, so nothing comes from the cache
+    h.handle(make_request(expected_times.size(), 1));
+    BOOST_CHECK_EQUAL(matrix_cache.size(), 2 * expected_times.size());
+}
+
+BOOST_AUTO_TEST_CASE(matrix_cell_key_test) {
+    const auto make_key = [](float percent_along, float speed) {
+        ModeCostingArgs args;
+        args.mode = "walking";
+        args.speeds[util::convert_navitia_to_valhalla_costing("walking")] = speed;
+        return MatrixCellKey{std::make_shared<const Projection>(Projection{{42, percent_along, false, false}}),
+                             std::make_shared<const Projection>(Projection{{43, 0.5f, false, true}}),
+                             std::make_shared<const ModeCostingArgs>(args),
+                             100000};
+    };
+
+    // The keys are compared by what they identify, not by their pointers nor their hashes
+    BOOST_CHECK(make_key(0.25f, 2) == make_key(0.25f, 2));
+    BOOST_CHECK_EQUAL(MatrixCellKeyHasher{}(make_key(0.25f, 2)), MatrixCellKeyHasher{}(make_key(0.25f, 2)));
+    BOOST_CHECK(!(make_key(0.25f, 2) == make_key(0.75f, 2)));
+    BOOST_CHECK(!(make_key(0.25f, 2) == make_key(0.25f, 1)));
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_on_arena_test, HandlerFixture) {
+    Context c{zmq_context, graph, metrics, projector};
+
+    Handler h{c};
+
+    google::protobuf::Arena arena;
+    auto* request = google::protobuf::Arena::Create<pbnavitia::Request>(&arena);
+    request->set_requested_api(pbnavitia::street_network_routing_matrix);
+    auto* sn_request = request->mutable_sn_routing_matrix();
+    add_origin_or_dest_to_request(sn_request->add_origins(),
+                                  make_string_from_point(maker.get_all_points().front()));
+    for (auto const& p : maker.get_all_points()) {
+        add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(p));
+    }
+    sn_request->set_mode("walking");
+    sn_request->set_max_duration(100000);
+    sn_request->set_speed(2);
+
+    auto* response = google::protobuf::Arena::Create<pbnavitia::Response>(&arena);
+    h.handle(*request, *response);
+
+    BOOST_CHECK_EQUAL(h.handle(*request).DebugString(), response->DebugString());
+    BOOST_CHECK_EQUAL(response->sn_routing_matrix().rows(0).routing_response_size(), maker.get_all_points().size());
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_in_chunks_test, HandlerFixture) {
+    ThreadPool thread_pool{2};
+    ContextOptions options;
+    options.thread_pool = &thread_pool;
+    options.matrix_chunk_size = 4;
+    Context chunked{zmq_context, graph, metrics, projector, options};
+    Context unchunked{zmq_context, graph, metrics, projector};
+
+    for (const bool one_to_many : {true, false}) {
+        UnitTestHandler chunked_handler{chunked};
+        UnitTestHandler unchunked_handler{unchunked};
+
+        pbnavitia::Request request;
+        request.set_requested_api(pbnavitia::street_network_routing_matrix);
+        auto* sn_request = request.mutable_sn_routing_matrix();
+        auto* single = one_to_many ? sn_request->add_origins() : sn_request->add_destinations();
+        add_origin_or_dest_to_request(single, make_string_from_point(maker.get_all_points().front()));
+        for (auto const& p : maker.get_all_points()) {
+            auto* other = one_to_many ? sn_request->add_destinations() : sn_request->add_origins();
+            add_origin_or_dest_to_request(other, make_string_from_point(p));
+        }
+        sn_request->set_mode("walking");
+        sn_request->set_max_duration(100000);
+        sn_request->set_speed(2);
+
+        const auto response = chunked_handler.handle(request);
+        BOOST_REQUIRE_EQUAL(response.sn_routing_matrix().rows(0).routing_response_size(), maker.get_all_points().size());
+        BOOST_CHECK_EQUAL(response.DebugString(), unchunked_handler.handle(request).DebugString());
+
+        // The 7 locations of the large side are routed in a chunk of 4 and a chunk of 3
+        BOOST_CHECK_EQUAL(chunked_handler.get_nb_matrix_searches(), 2u);
+        BOOST_CHECK_EQUAL(unchunked_handler.get_nb_matrix_searches(), 1u);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(compute_matrix_in_chunks_test, HandlerFixture) {
+    ThreadPool thread_pool{2};
+    // chunks of 2 locations: both sides of the NxM matrices are larger than a chunk
+    ContextOptions options;
+    options.thread_pool = &thread_pool;
+    options.matrix_chunk_size = 2;
+    Context chunked{zmq_context, graph, metrics, projector, options};
+    Context unchunked{zmq_context, graph, metrics, projector};
+
+    const auto& points = maker.get_all_points();
+    const std::vector<midgard::PointLL> three_points(points.begin(), points.begin() + 3);
+    const std::vector<midgard::PointLL> one_point(points.begin(), points.begin() + 1);
+
+    // The sources, the targets and the number of searches of the chunked matrix
+    const std::vector<std::tuple<std::vector<midgard::PointLL>, std::vector<midgard::PointLL>, size_t>> matrices = {
+        // the side valhalla searches from is split, none of its searches is run twice
+        std::make_tuple(three_points, points, 3),
+        std::make_tuple(points, three_points, 3),
+        std::make_tuple(points, points, 6),
+        // the single search is run once per chunk of 2 of the 6 targets
+        std::make_tuple(one_point, points, 3),
+        std::make_tuple(points, one_point, 3)};
+
+    for (const auto& matrix : matrices) {
+        const auto& sources = std::get<0>(matrix);
+        const auto& targets = std::get<1>(matrix);
+        UnitTestHandler chunked_handler{chunked};
+        UnitTestHandler unchunked_handler{unchunked};
+
+        const auto res = chunked_handler.compute_matrix(sources, targets);
+        const auto expected = unchunked_handler.compute_matrix(sources, targets);
+        BOOST_REQUIRE_EQUAL(res.size(), sources.size() * targets.size());
+        BOOST_REQUIRE_EQUAL(expected.size(), res.size());
+        for (size_t i = 0; i < res.size(); ++i) {
+            BOOST_CHECK_EQUAL(res[i].time, expected[i].time);
+            BOOST_CHECK_EQUAL(res[i].dist, expected[i].dist);
+        }
+
+        BOOST_CHECK_EQUAL(chunked_handler.get_nb_matrix_searches(), std::get<2>(matrix));
+        BOOST_CHECK_EQUAL(unchunked_handler.get_nb_matrix_searches(), std::min(sources.size(), targets.size()));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_crow_fly_filter_test, HandlerFixture) {
+    ContextOptions options;
+    options.matrix_crow_fly_filter = true;
+    Context filtered{zmq_context, graph, metrics, projector, options};
+    Context not_filtered{zmq_context, graph, metrics, projector};
+
+    Handler filtered_handler{filtered};
+    Handler not_filtered_handler{not_filtered};
+
+    pbnavitia::Request request;
+    request.set_requested_api(pbnavitia::street_network_routing_matrix);
+    auto* sn_request = request.mutable_sn_routing_matrix();
+    const auto origin = maker.get_all_points().front();
+    add_origin_or_dest_to_request(sn_request->add_origins(), make_string_from_point(origin));
+    for (auto const& p : maker.get_all_points()) {
+        add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(p));
+    }
+    // About 110km away, far beyond the reach of 1000s of walk
+    const midgard::PointLL far_away{origin.lng(), origin.lat() + 1};
+    add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(far_away));
+    sn_request->set_mode("walking");
+    sn_request->set_max_duration(1000);
+    sn_request->set_speed(2);
+
+    const auto response = filtered_handler.handle(request);
+    BOOST_CHECK_EQUAL(response.DebugString(), not_filtered_handler.handle(request).DebugString());
+
+    const auto& row = response.sn_routing_matrix().rows(0);
+    BOOST_REQUIRE_EQUAL(row.routing_response_size(), maker.get_all_points().size() + 1);
+    const auto& pruned = row.routing_response(row.routing_response_size() - 1);
+    BOOST_CHECK_EQUAL(pruned.duration(), -1);
+    BOOST_CHECK_EQUAL(pruned.routing_status(), pbnavitia::RoutingStatus::unreached);
+
+    // Everything is out of reach from an origin far away on the other side, nothing is projected
+    const midgard::PointLL other_side{origin.lng(), origin.lat() - 1};
+    sn_request->mutable_origins(0)->set_place(make_string_from_point(other_side));
+    const auto far_response = filtered_handler.handle(request);
+    BOOST_CHECK(!far_response.has_error());
+    for (const auto& r : far_response.sn_routing_matrix().rows(0).routing_response()) {
+        BOOST_CHECK_EQUAL(r.routing_status(), pbnavitia::RoutingStatus::unreached);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_with_duplicated_locations_test, HandlerFixture) {
+    Context c{zmq_context, graph, metrics, projector};
+    UnitTestHandler h{c};
+
+    const auto make_request = [&](size_t nb_copies) {
+        pbnavitia::Request request;
+        request.set_requested_api(pbnavitia::street_network_routing_matrix);
+        auto* sn_request = request.mutable_sn_routing_matrix();
+        add_origin_or_dest_to_request(sn_request->add_origins(), make_string_from_point(maker.get_all_points().front()));
+        for (size_t i = 0; i < nb_copies; ++i) {
+            for (auto const& p : maker.get_all_points()) {
+                add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(p));
+            }
+        }
+        sn_request->set_mode("walking");
+        sn_request->set_max_duration(100000);
+        sn_request->set_speed(2);
+        return request;
+    };
+
+    const auto response = h.handle(make_request(1));
+    const auto nb_routed_locations = h.get_nb_matrix_routed_locations();
+    // the origin and each distinct destination
+    BOOST_CHECK_EQUAL(nb_routed_locations, 1 + maker.get_all_points().size());
+
+    // Only the first copy of each destination is routed
+    const auto duplicated_response = h.handle(make_request(3));
+    BOOST_CHECK_EQUAL(h.get_nb_matrix_routed_locations() - nb_routed_locations, nb_routed_locations);
+    const auto& row = response.sn_routing_matrix().rows(0);
+    const auto& duplicated_row = duplicated_response.sn_routing_matrix().rows(0);
+    BOOST_REQUIRE_EQUAL(duplicated_row.routing_response_size(), 3 * row.routing_response_size());
+    // Every copy gets the result of its original
+    for (int i = 0; i < duplicated_row.routing_response_size(); ++i) {
+        BOOST_CHECK_EQUAL(duplicated_row.routing_response(i).DebugString(),
+                          row.routing_response(i % row.routing_response_size()).DebugString());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_by_batches_test, HandlerFixture) {
+    Context whole{zmq_context, graph, metrics, projector};
+    // Batches of 3 locations
+    ContextOptions options;
+    options.matrix_batch_size = 3;
+    Context batched{zmq_context, graph, metrics, projector, options};
+
+    Handler whole_handler{whole};
+    UnitTestHandler batched_handler{batched};
+
+    for (const bool one_to_many : {true, false}) {
+        pbnavitia::Request request;
+        request.set_requested_api(pbnavitia::street_network_routing_matrix);
+        auto* sn_request = request.mutable_sn_routing_matrix();
+        auto* single = one_to_many ? sn_request->add_origins() : sn_request->add_destinations();
+        add_origin_or_dest_to_request(single, make_string_from_point(maker.get_all_points().front()));
+        for (auto const& p : maker.get_all_points()) {
+            auto* other = one_to_many ? sn_request->add_destinations() : sn_request->add_origins();
+            add_origin_or_dest_to_request(other, make_string_from_point(p));
+        }
+        // a location far away, reported unreached, in the last batch
+        auto* other = one_to_many ? sn_request->add_destinations() : sn_request->add_origins();
+        add_origin_or_dest_to_request(other, "coord:10:10");
+        sn_request->set_mode("walking");
+        sn_request->set_max_duration(100000);
+        sn_request->set_speed(2);
+
+        const auto nb_searches = batched_handler.get_nb_matrix_searches();
+        const auto response = batched_handler.handle(request);
+        BOOST_CHECK_EQUAL(response.DebugString(), whole_handler.handle(request).DebugString());
+        BOOST_CHECK_EQUAL(response.sn_routing_matrix().rows(0).routing_response_size(), maker.get_all_points().size() + 1);
+        // Only the projection is batched, the row is routed by a single search from the lone location
+        BOOST_CHECK_EQUAL(batched_handler.get_nb_matrix_searches() - nb_searches, 1u);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_streamed_test, HandlerFixture) {
+    // Chunks of 2 cells
+    ContextOptions options;
+    options.matrix_stream_size = 2;
+    Context c{zmq_context, graph, metrics, projector, options};
+    UnitTestHandler h{c};
+
+    pbnavitia::Request request;
+    request.set_requested_api(pbnavitia::street_network_routing_matrix);
+    auto* sn_request = request.mutable_sn_routing_matrix();
+    add_origin_or_dest_to_request(sn_request->add_origins(), make_string_from_point(maker.get_all_points().front()));
+    for (auto const& p : maker.get_all_points()) {
+        add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(p));
+    }
+    sn_request->set_mode("walking");
+    sn_request->set_max_duration(100000);
+    sn_request->set_speed(2);
+
+    std::vector<pbnavitia::Response> chunks;
+    pbnavitia::Response last_chunk;
+    h.handle(request, last_chunk, [&](const pbnavitia::Response& chunk) {
+        chunks.push_back(chunk);
+        // A chunk is sent as soon as it is routed, before the next chunks are
+        BOOST_CHECK_EQUAL(h.get_nb_matrix_searches(), chunks.size());
+    });
+    chunks.push_back(last_chunk);
+
+    const auto nb_points = maker.get_all_points().size();
+    BOOST_CHECK_EQUAL(chunks.size(), (nb_points + 1) / 2);
+    BOOST_CHECK_EQUAL(h.get_nb_matrix_searches(), chunks.size());
+    // The cells of the chunks, one after the other, are the ones of a single response
+    pbnavitia::Response streamed;
+    auto* row = streamed.mutable_sn_routing_matrix()->add_rows();
+    for (const auto& chunk : chunks) {
+        BOOST_CHECK_LE(chunk.sn_routing_matrix().rows(0).routing_response_size(), 2);
+        for (const auto& cell : chunk.sn_routing_matrix().rows(0).routing_response()) {
+            *row->add_routing_response() = cell;
+        }
+    }
+    BOOST_CHECK_EQUAL(streamed.DebugString(), h.handle(request).DebugString());
+}
+
+BOOST_FIXTURE_TEST_CASE(handle_matrix_with_more_than_10000_locations_test, HandlerFixture) {
+    ContextOptions options;
+    options.matrix_batch_size = 5000;
+    Context c{zmq_context, graph, metrics, projector, options};
+    UnitTestHandler h{c};
+
+    pbnavitia::Request request;
+    request.set_requested_api(pbnavitia::street_network_routing_matrix);
+    auto* sn_request = request.mutable_sn_routing_matrix();
+    add_origin_or_dest_to_request(sn_request->add_origins(), make_string_from_point(maker.get_all_points().front()));
+    const size_t nb_targets = 12000;
+    for (size_t i = 0; i < nb_targets; ++i) {
+        const auto& p = maker.get_all_points()[i % maker.get_all_points().size()];
+        add_origin_or_dest_to_request(sn_request->add_destinations(), make_string_from_point(p));
+    }
+    sn_request->set_mode("walking");
+    sn_request->set_max_duration(100000);
+    sn_request->set_speed(2);
+
+    const auto response = h.handle(request);
+    BOOST_CHECK(!response.has_error());
+    BOOST_CHECK_EQUAL(response.sn_routing_matrix().rows(0).routing_response_size(), nb_targets);
+}
+
 void check_journey_trivial_direct_path(const pbnavitia::Response& response,
                                        const std::string& origin_uri,
                                        const std::string& destination_uri,
@@ -175,6 +571,53 @@ BOOST_AUTO_TEST_CASE(handle_direct_path_trivial_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(handle_direct_path_without_instructions_test) {
+    tile_maker::TileMaker maker;
+    maker.make_tile();
+
+    zmq::context_t context(1);
+    const Metrics metrics{boost::none};
+    const Projector projector{10, 0, 0};
+
+    boost::property_tree::ptree conf;
+    conf.put("tile_dir", maker.get_tile_dir());
+    valhalla::baldr::GraphReader graph(conf);
+    Context c{context, graph, metrics, projector};
+
+    Handler h{c};
+
+    pbnavitia::Request request;
+    request.set_requested_api(pbnavitia::direct_path);
+    auto* dp_request = request.mutable_direct_path();
+    add_origin_or_dest_to_request(dp_request->mutable_origin(),
+                                  make_string_from_point(maker.get_all_points().front()));
+    add_origin_or_dest_to_request(dp_request->mutable_destination(),
+                                  make_string_from_point(maker.get_all_points().at(3)));
+    auto* sn_params = dp_request->mutable_streetnetwork_params();
+    sn_params->set_origin_mode("walking");
+    sn_params->set_walking_speed(2);
+
+    sn_params->set_enable_instructions(true);
+    const auto with_instructions = h.handle(request);
+    sn_params->set_enable_instructions(false);
+    const auto without_instructions = h.handle(request);
+
+    // Same path items, only the text is missing
+    const auto& expected = with_instructions.journeys(0).sections(0).street_network();
+    const auto& sn = without_instructions.journeys(0).sections(0).street_network();
+    BOOST_REQUIRE_EQUAL(sn.path_items_size(), expected.path_items_size());
+    BOOST_REQUIRE_GT(sn.path_items_size(), 0);
+    BOOST_CHECK(!expected.path_items(0).instruction().empty());
+    for (int i = 0; i < sn.path_items_size(); ++i) {
+        BOOST_CHECK_EQUAL(sn.path_items(i).length(), expected.path_items(i).length());
+        BOOST_CHECK_EQUAL(sn.path_items(i).duration(), expected.path_items(i).duration());
+        BOOST_CHECK_EQUAL(sn.path_items(i).direction(), expected.path_items(i).direction());
+        BOOST_CHECK_EQUAL(sn.path_items(i).name(), expected.path_items(i).name());
+        BOOST_CHECK(sn.path_items(i).instruction().empty());
+    }
+    BOOST_CHECK_EQUAL(without_instructions.journeys(0).duration(), with_instructions.journeys(0).duration());
+}
+
 void check_bss_journey_direct_path(const pbnavitia::Response& response,
                                    const std::vector<float>& expected_section_length,
                                    const std::vector<float>& expected_section_duration) {
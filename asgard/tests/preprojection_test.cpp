@@ -0,0 +1,51 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE preprojection_test
+
+#include "tile_maker.h"
+
+#include "asgard/mode_costing.h"
+#include "asgard/preprojection.h"
+#include "asgard/projector.h"
+#include "asgard/thread_pool.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+
+namespace asgard {
+
+BOOST_FIXTURE_TEST_CASE(preprojection_test, tile_maker::GraphFixture) {
+    const auto locations = maker.get_all_points();
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    {
+        std::ofstream out(path);
+        out << "# stop points\n";
+        for (const auto& l : locations) {
+            out << "coord:" << l.lng() << ":" << l.lat() << "\n";
+        }
+        out << "\nplop\n";
+    }
+    const auto stops = preprojection::read_stop_list(path);
+    BOOST_CHECK_EQUAL(stops.size(), locations.size());
+
+    Projector p(1000);
+    ThreadPool pool(2);
+    size_t nb_chunks_done = 0;
+    const auto nb_projected = preprojection::preproject(p, stops, {"car", "walking"}, graph, pool, 3,
+                                                        [&](size_t done, size_t total) {
+                                                            BOOST_CHECK_EQUAL(done, ++nb_chunks_done);
+                                                            BOOST_CHECK_GE(total, done);
+                                                        });
+    BOOST_CHECK_EQUAL(nb_projected, 2 * locations.size());
+    BOOST_CHECK_EQUAL(p.get_current_cache_size(), 2 * locations.size());
+
+    // Everything is now in the cache
+    ModeCosting mode_costing;
+    p(begin(stops), end(stops), graph, "car", mode_costing.get_costing_for_mode("car"));
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2 * locations.size());
+
+    boost::filesystem::remove(path);
+}
+
+} // namespace asgard
@@ -0,0 +1,48 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE projector_snapshot_test
+
+#include "tile_maker.h"
+
+#include "asgard/mode_costing.h"
+#include "asgard/projector.h"
+#include "asgard/projector_snapshot.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace asgard {
+
+BOOST_FIXTURE_TEST_CASE(projector_snapshot_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const auto locations = maker.get_all_points();
+    const auto version = projector_snapshot::get_tileset_version(graph);
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+    Projector p(1000);
+    const auto expected = p(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(projector_snapshot::save(p, path, version, graph), locations.size());
+
+    // Every projection is restored, no search needed
+    Projector restored(1000);
+    BOOST_CHECK_EQUAL(projector_snapshot::load(restored, path, version), locations.size());
+    BOOST_CHECK_EQUAL(restored.get_current_cache_size(), locations.size());
+    const auto result = restored(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(restored.get_nb_cache_miss(), 0);
+    for (const auto& l : locations) {
+        BOOST_CHECK_EQUAL(result.at(l).edges.size(), expected.at(l).edges.size());
+        BOOST_CHECK_EQUAL(result.at(l).edges.front().id, expected.at(l).edges.front().id);
+    }
+
+    // A snapshot made on other tiles is rejected
+    Projector stale(1000);
+    BOOST_CHECK_EQUAL(projector_snapshot::load(stale, path, version + "-other"), 0);
+    BOOST_CHECK_EQUAL(stale.get_current_cache_size(), 0);
+
+    // A missing snapshot is not an error
+    BOOST_CHECK_EQUAL(projector_snapshot::load(stale, path + "-missing", version), 0);
+
+    boost::filesystem::remove(path);
+}
+
+} // namespace asgard
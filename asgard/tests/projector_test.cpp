@@ -4,7 +4,9 @@
 #include "tile_maker.h"
 
 #include "asgard/mode_costing.h"
+#include "asgard/packed_location.h"
 #include "asgard/projector.h"
+#include "asgard/thread_pool.h"
 #include "asgard/util.h"
 
 #include <boost/property_tree/ptree.hpp>
@@ -36,6 +38,13 @@ private:
     Projector p;
 };
 
+ProjectorOptions make_options(size_t cache_size, size_t nb_shards) {
+    ProjectorOptions options;
+    options.cache_size = cache_size;
+    options.nb_shards = nb_shards;
+    return options;
+}
+
 std::vector<valhalla::midgard::PointLL>
 make_pointLLs(const std::vector<std::string> coords) {
     std::vector<valhalla::midgard::PointLL> pointLLs;
@@ -116,6 +125,242 @@ BOOST_AUTO_TEST_CASE(simple_projector_test) {
     // cache = { coord:.009:.001; coord:.013:.001 }
 }
 
+BOOST_FIXTURE_TEST_CASE(sharded_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+
+    // Too small to be sharded
+    {
+        Projector p(make_options(10, 16));
+        BOOST_CHECK_EQUAL(p.get_nb_shards(), 1);
+    }
+
+    Projector p(make_options(1000, 8));
+    BOOST_CHECK_EQUAL(p.get_nb_shards(), 8);
+
+    const auto locations = maker.get_all_points();
+    auto first = p(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(first.size(), locations.size());
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), locations.size());
+    BOOST_CHECK_EQUAL(p.get_current_cache_size(), locations.size());
+
+    // Every location is now found in its shard
+    auto second = p(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(second.size(), locations.size());
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), locations.size());
+    BOOST_CHECK_EQUAL(p.get_nb_cache_calls(), 2 * locations.size());
+    for (const auto& l : locations) {
+        BOOST_CHECK_EQUAL(first.at(l).edges.size(), second.at(l).edges.size());
+    }
+
+    // The mode is part of the key
+    p(begin(locations), end(locations), graph, "walking", mode_costing.get_costing_for_mode("walking"));
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2 * locations.size());
+    BOOST_CHECK_EQUAL(p.get_current_cache_size(), 2 * locations.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(grid_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+
+    // Cells of 100m
+    auto options = make_options(1000, 1);
+    options.grid_cell_size = 100;
+    Projector p(options);
+    const auto location = maker.get_all_points().front();
+    const std::vector<midgard::PointLL> first{location};
+    p(begin(first), end(first), graph, "car", costing);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 1);
+
+    // A few centimeters away, the projection of the first location is reused
+    const std::vector<midgard::PointLL> near{{location.lng() + 0.0000003f, location.lat() - 0.0000003f}};
+    const auto projected = p(begin(near), end(near), graph, "car", costing);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 1);
+    BOOST_CHECK_EQUAL(projected.size(), 1);
+    BOOST_CHECK_EQUAL(projected.count(near.front()), 1);
+
+    // A kilometer away is another cell
+    const std::vector<midgard::PointLL> far{{location.lng(), location.lat() + 0.01f}};
+    p(begin(far), end(far), graph, "car", costing);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2);
+
+    // Without a grid, every coordinate is a key of its own
+    Projector exact(make_options(1000, 1));
+    exact(begin(first), end(first), graph, "car", costing);
+    exact(begin(near), end(near), graph, "car", costing);
+    BOOST_CHECK_EQUAL(exact.get_nb_cache_miss(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(negative_cache_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+
+    // Far from the tile, the projection fails
+    const std::vector<midgard::PointLL> locations{maker.get_all_points().front(), {10, 10}};
+
+    auto options = make_options(1000, 1);
+    options.negative_cache_size = 100;
+    options.negative_cache_ttl = 600;
+    Projector p(options);
+    BOOST_CHECK_EQUAL(p(begin(locations), end(locations), graph, "car", costing).size(), 1);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2);
+    BOOST_CHECK_EQUAL(p.get_current_negative_cache_size(), 1);
+
+    // The failure is remembered, nothing is searched again
+    BOOST_CHECK_EQUAL(p(begin(locations), end(locations), graph, "car", costing).size(), 1);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2);
+    BOOST_CHECK_EQUAL(p.get_nb_negative_cache_hits(), 1);
+
+    // Per mode
+    p(begin(locations), end(locations), graph, "walking", mode_costing.get_costing_for_mode("walking"));
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 4);
+    BOOST_CHECK_EQUAL(p.get_current_negative_cache_size(), 2);
+
+    // Once the ttl is over, the place is searched again
+    options.negative_cache_ttl = 0;
+    Projector expired(options);
+    expired(begin(locations), end(locations), graph, "car", costing);
+    expired(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(expired.get_nb_cache_miss(), 3);
+    BOOST_CHECK_EQUAL(expired.get_nb_negative_cache_hits(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(packed_projection_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const auto locations = maker.get_all_points();
+
+    // A hit gives back the projection found by loki
+    Projector p(1000);
+    const auto searched = p(begin(locations), end(locations), graph, "car", costing, false);
+    p(begin(locations), end(locations), graph, "car", costing);
+    const auto cached = p(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), locations.size());
+    BOOST_REQUIRE_EQUAL(cached.size(), searched.size());
+    for (const auto& l : searched) {
+        const auto& expected = l.second.edges;
+        const auto& result = cached.at(l.first).edges;
+        BOOST_CHECK_EQUAL(cached.at(l.first).latlng_, l.first);
+        BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            BOOST_CHECK_EQUAL(result[i].id, expected[i].id);
+            BOOST_CHECK_EQUAL(result[i].percent_along, expected[i].percent_along);
+            BOOST_CHECK_EQUAL(result[i].distance, expected[i].distance);
+            BOOST_CHECK_EQUAL(result[i].sos, expected[i].sos);
+            BOOST_CHECK_EQUAL(result[i].begin_node(), expected[i].begin_node());
+            BOOST_CHECK_EQUAL(result[i].end_node(), expected[i].end_node());
+            BOOST_CHECK_CLOSE(result[i].projected.lng(), expected[i].projected.lng(), .0001);
+            BOOST_CHECK_CLOSE(result[i].projected.lat(), expected[i].projected.lat(), .0001);
+        }
+        BOOST_CHECK_EQUAL(cached.at(l.first).filtered_edges.size(), l.second.filtered_edges.size());
+    }
+
+    // The edges of a place projected in the middle of a way are stored inline
+    const auto packed = pack(searched.begin()->second);
+    BOOST_CHECK_EQUAL(sizeof(PackedEdge), 32);
+    BOOST_CHECK_EQUAL(PackedLocationHeapSize{}(packed), packed.size() > NB_INLINE_EDGES ? packed.size() * sizeof(PackedEdge) : 0);
+    BOOST_CHECK_GT(p.get_cache_memory_usage(), 0);
+
+    // bss places share the walking projections
+    const auto walking = mode_costing.get_costing_for_mode("walking");
+    p(begin(locations), end(locations), graph, "walking", walking);
+    p(begin(locations), end(locations), graph, "bss", walking);
+    BOOST_CHECK_EQUAL(p.get_nb_cache_miss(), 2 * locations.size());
+    BOOST_CHECK_EQUAL(p.get_current_cache_size(), 2 * locations.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(byte_budget_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const auto locations = maker.get_all_points();
+
+    Projector unbounded(make_options(1000, 1));
+    unbounded(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(unbounded.get_current_cache_size(), locations.size());
+    const auto all_bytes = unbounded.get_cache_memory_usage();
+    BOOST_CHECK_GT(all_bytes, locations.size() * sizeof(PackedEdge));
+
+    // With half of the bytes, the entries are evicted before the cache is full
+    const auto budget = all_bytes / 2;
+    auto options = make_options(1000, 1);
+    options.cache_bytes = budget;
+    Projector bounded(options);
+    bounded(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_LT(bounded.get_current_cache_size(), locations.size());
+    BOOST_CHECK_GT(bounded.get_current_cache_size(), 0);
+    BOOST_CHECK_LE(bounded.get_cache_memory_usage(), budget);
+}
+
+BOOST_FIXTURE_TEST_CASE(admission_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    const auto& points = maker.get_all_points();
+    BOOST_REQUIRE_GE(points.size(), 6);
+    const std::vector<midgard::PointLL> popular{points[0]};
+    const std::vector<midgard::PointLL> other{points[1]};
+    // Each of them seen once, like the targets of a matrix from a one-off address
+    const std::vector<midgard::PointLL> scan(points.begin() + 2, points.begin() + 6);
+
+    auto options = make_options(2, 1);
+    Projector plain(options);
+    options.cache_admission = true;
+    Projector admission(options);
+    for (auto* p : {&plain, &admission}) {
+        for (size_t i = 0; i < 3; ++i) {
+            (*p)(begin(popular), end(popular), graph, "car", costing);
+        }
+        (*p)(begin(other), end(other), graph, "car", costing);
+        for (const auto& place : scan) {
+            const std::vector<midgard::PointLL> one{place};
+            (*p)(begin(one), end(one), graph, "car", costing);
+        }
+        BOOST_CHECK_EQUAL(p->get_nb_cache_miss(), 6);
+        (*p)(begin(popular), end(popular), graph, "car", costing);
+    }
+
+    // The scan flushed the popular place from the plain cache
+    BOOST_CHECK_EQUAL(plain.get_nb_cache_miss(), 7);
+    BOOST_CHECK_EQUAL(plain.get_nb_cache_rejected(), 0);
+
+    // but wasn't admitted in the other one
+    BOOST_CHECK_EQUAL(admission.get_nb_cache_miss(), 6);
+    BOOST_CHECK_EQUAL(admission.get_nb_cache_rejected(), scan.size());
+    BOOST_CHECK_EQUAL(admission.get_current_cache_size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(parallel_search_projector_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    auto costing = mode_costing.get_costing_for_mode("car");
+    auto locations = maker.get_all_points();
+    locations.emplace_back(10, 10);
+
+    Projector serial(1000);
+    const auto expected = serial(begin(locations), end(locations), graph, "car", costing);
+
+    // The misses are searched by chunks of 2 on the helpers and the caller, and merged in the cache
+    ThreadPool pool(2);
+    auto options = make_options(1000, 16);
+    options.search_pool = &pool;
+    options.search_chunk_size = 2;
+    Projector parallel(options);
+    const auto result = parallel(begin(locations), end(locations), graph, "car", costing);
+    BOOST_CHECK_EQUAL(parallel.get_nb_cache_miss(), locations.size());
+    BOOST_CHECK_EQUAL(parallel.get_current_cache_size(), expected.size());
+    BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+    for (const auto& l : expected) {
+        BOOST_REQUIRE_EQUAL(result.count(l.first), 1);
+        BOOST_CHECK_EQUAL(result.at(l.first).edges.size(), l.second.edges.size());
+        BOOST_CHECK_EQUAL(result.at(l.first).edges.front().id, l.second.edges.front().id);
+    }
+
+    // From a helper of the same pool, the caller searches the chunks no other helper is free for
+    auto from_helper = pool.submit([&]() {
+        const Projector nested(options);
+        return nested(begin(locations), end(locations), graph, "car", costing).size();
+    });
+    BOOST_CHECK_EQUAL(from_helper.get(), expected.size());
+}
+
 BOOST_AUTO_TEST_CASE(build_location_test) {
     UnitTestProjector testProjector(3);
     {
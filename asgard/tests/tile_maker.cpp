@@ -169,6 +169,20 @@ void TileMaker::make_tile() {
     GraphTileBuilder::AddBins(tile_dir, reloaded, bins);
 }
 
+namespace {
+
+boost::property_tree::ptree make_graph_conf(TileMaker& maker) {
+    maker.make_tile();
+    boost::property_tree::ptree conf;
+    conf.put("tile_dir", maker.get_tile_dir());
+    return conf;
+}
+
+} // namespace
+
+GraphFixture::GraphFixture() : conf(make_graph_conf(maker)),
+                               graph(conf) {}
+
 } // namespace tile_maker
 
 } // namespace asgard
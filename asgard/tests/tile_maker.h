@@ -16,9 +16,12 @@
 
 #pragma once
 
+#include <valhalla/baldr/graphreader.h>
 #include <valhalla/baldr/tilehierarchy.h>
 #include <valhalla/mjolnir/graphtilebuilder.h>
 
+#include <boost/property_tree/ptree.hpp>
+
 #include <string>
 
 #if !defined(TESTS_BUILD_DIR)
@@ -59,6 +62,15 @@ public:
 
     const std::vector<PointLL> all_points = {a.second, b.second, c.second, d.second, e.second, f.second};
 };
+
+// The test tile and a graph reading it, for the test cases declared with BOOST_FIXTURE_TEST_CASE
+struct GraphFixture {
+    GraphFixture();
+
+    TileMaker maker;
+    boost::property_tree::ptree conf;
+    valhalla::baldr::GraphReader graph;
+};
 } // namespace tile_maker
 
 } // namespace asgard
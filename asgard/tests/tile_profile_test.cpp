@@ -0,0 +1,55 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE tile_profile_test
+
+#include "tile_maker.h"
+
+#include "asgard/mode_costing.h"
+#include "asgard/projector.h"
+#include "asgard/tile_profile.h"
+
+#include <valhalla/baldr/graphreader.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace asgard {
+
+BOOST_FIXTURE_TEST_CASE(tile_profile_test, tile_maker::GraphFixture) {
+    ModeCosting mode_costing;
+    const auto locations = maker.get_all_points();
+    Projector p(1000);
+    const auto projected = p(begin(locations), end(locations), graph, "car", mode_costing.get_costing_for_mode("car"));
+
+    ProjectionTileProfile profile;
+    std::vector<uint64_t> edges;
+    for (const auto& l : projected) {
+        edges.push_back(l.second.edges.front().id.value);
+    }
+    profile.record(edges);
+    profile.record({edges.front()});
+
+    // All the edges of the test are in the same tile
+    const auto hottest = profile.get_hottest_tiles();
+    BOOST_REQUIRE_EQUAL(hottest.size(), 1);
+    BOOST_CHECK_EQUAL(hottest.front().first, projected.begin()->second.edges.front().id.Tile_Base().value);
+    BOOST_CHECK_EQUAL(hottest.front().second, edges.size() + 1);
+
+    // The counts are halved when loaded
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    BOOST_CHECK(profile.save(path));
+    ProjectionTileProfile loaded;
+    BOOST_CHECK_EQUAL(loaded.load(path), 1);
+    BOOST_CHECK_EQUAL(loaded.get_hottest_tiles().front().second, (edges.size() + 1) / 2);
+    boost::filesystem::remove(path);
+
+    // The tile is only loaded when it fits in the budget
+    valhalla::baldr::GraphReader cold_graph(conf);
+    BOOST_CHECK_EQUAL(warmup_tiles(cold_graph, hottest, 0), 0);
+    size_t nb_progress = 0;
+    BOOST_CHECK_EQUAL(warmup_tiles(cold_graph, hottest, 1000000000, [&](size_t, size_t) { ++nb_progress; }), 1);
+    BOOST_CHECK_EQUAL(nb_progress, 1);
+}
+
+} // namespace asgard
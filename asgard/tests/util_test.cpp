@@ -1,8 +1,12 @@
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE util_test
 
+#include "asgard/crow_fly.h"
+#include "asgard/mode_costing.h"
+#include "asgard/request_capture.h"
 #include "asgard/util.h"
 #include <valhalla/sif/costconstants.h>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace valhalla;
@@ -53,4 +57,85 @@ BOOST_AUTO_TEST_CASE(convert_valhalla_to_navitia_cycle_lane_test) {
 
 } // namespace util
 
+BOOST_AUTO_TEST_CASE(request_capture_test) {
+    const auto path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    const std::string binary("a\0b", 3);
+    {
+        RequestRecorder recorder(path, 1);
+        recorder.record("first", 5);
+        recorder.record("", 0);
+        recorder.record(binary.data(), binary.size());
+        BOOST_CHECK_EQUAL(recorder.get_nb_recorded(), 3);
+
+        RequestRecorder never(path, 0);
+        never.record("never", 5);
+        BOOST_CHECK_EQUAL(never.get_nb_recorded(), 0);
+    }
+    const auto requests = read_captured_requests(path);
+    BOOST_REQUIRE_EQUAL(requests.size(), 3);
+    BOOST_CHECK_EQUAL(requests[0], "first");
+    BOOST_CHECK_EQUAL(requests[1], "");
+    BOOST_CHECK_EQUAL(requests[2], binary);
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(costing_cache_test) {
+    CostingCache cache(2);
+    ModeCostingArgs walking;
+    walking.mode = "walking";
+    walking.speeds[vc::pedestrian] = 1.12;
+
+    // The same arguments share the same costing
+    const auto first = cache.get(walking);
+    BOOST_CHECK_EQUAL(cache.get(walking), first);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    ModeCostingArgs faster = walking;
+    faster.speeds[vc::pedestrian] = 1.5;
+    BOOST_CHECK(!(faster == walking));
+    BOOST_CHECK(cache.get(faster) != first);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+
+    // Beyond the max size, the costings are still built
+    ModeCostingArgs bike;
+    bike.mode = "bike";
+    BOOST_CHECK(cache.get(bike) != nullptr);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+
+    // A mode costing with a cache builds the costing of the same arguments once
+    ModeCosting mode_costing(2);
+    mode_costing.update_costing(walking);
+    const auto walking_costing = mode_costing.get_costing_for_mode("walking");
+    mode_costing.update_costing(faster);
+    BOOST_CHECK(mode_costing.get_costing_for_mode("walking") != walking_costing);
+    mode_costing.update_costing(walking);
+    BOOST_CHECK_EQUAL(mode_costing.get_costing_for_mode("walking"), walking_costing);
+}
+
+BOOST_AUTO_TEST_CASE(crow_fly_mark_out_of_reach_test) {
+    // 0.01 degree of longitude is about 730m at this latitude, 0.1 degree of latitude about 11km
+    const std::vector<midgard::PointLL> sources = {{2.35, 48.85}, {2.35, 48.95}};
+    const std::vector<midgard::PointLL> targets = {{2.36, 48.85}, {2.45, 48.85}, {2.35, 48.96}, {3.35, 48.85}};
+    std::vector<bool> sources_out_of_reach;
+    std::vector<bool> targets_out_of_reach;
+
+    crow_fly::mark_out_of_reach(sources, targets, 1000, sources_out_of_reach, targets_out_of_reach);
+    BOOST_CHECK((sources_out_of_reach == std::vector<bool>{false, false}));
+    BOOST_CHECK((targets_out_of_reach == std::vector<bool>{false, true, false, true}));
+
+    crow_fly::mark_out_of_reach({sources.front()}, targets, 1000, sources_out_of_reach, targets_out_of_reach);
+    BOOST_CHECK((sources_out_of_reach == std::vector<bool>{false}));
+    BOOST_CHECK((targets_out_of_reach == std::vector<bool>{false, true, true, true}));
+
+    crow_fly::mark_out_of_reach({{100, 0}}, targets, 1000, sources_out_of_reach, targets_out_of_reach);
+    BOOST_CHECK((sources_out_of_reach == std::vector<bool>{true}));
+    BOOST_CHECK((targets_out_of_reach == std::vector<bool>{true, true, true, true}));
+
+    // Beyond half the earth's circumference, everything is in reach
+    crow_fly::mark_out_of_reach({{100, 0}}, targets, 30000000, sources_out_of_reach, targets_out_of_reach);
+    BOOST_CHECK((sources_out_of_reach == std::vector<bool>{false}));
+    BOOST_CHECK((targets_out_of_reach == std::vector<bool>{false, false, false, false}));
+}
+
 } // namespace asgard
@@ -0,0 +1,64 @@
+// Copyright 2017-2018, CanalTP and/or its affiliates. All rights reserved.
+//
+// LICENCE: This program is free software; you can redistribute it
+// and/or modify it under the terms of the GNU Affero General Public
+// License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public
+// License along with this program. If not, see
+// <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace asgard {
+
+// Fixed size pool of helper threads shared by all the workers.
+// It is used to split the computation of a single request across several cores.
+class ThreadPool : boost::noncopyable {
+public:
+    explicit ThreadPool(size_t nb_threads);
+    ~ThreadPool();
+
+    size_t size() const { return threads.size(); }
+
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F&& f) {
+        using R = typename std::result_of<F()>::type;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return future;
+    }
+
+private:
+    void run();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopped = false;
+};
+
+} // namespace asgard
@@ -0,0 +1,115 @@
+#include "asgard/tile_profile.h"
+
+#include <valhalla/baldr/graphid.h>
+#include <valhalla/baldr/graphreader.h>
+#include <valhalla/midgard/logging.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+using namespace valhalla;
+
+namespace asgard {
+
+void ProjectionTileProfile::record(const std::vector<uint64_t>& tile_ids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto id : tile_ids) {
+        ++counts[baldr::GraphId(id).Tile_Base().value];
+    }
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> ProjectionTileProfile::get_hottest_tiles() const {
+    std::vector<std::pair<uint64_t, uint64_t>> tiles;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles.assign(counts.begin(), counts.end());
+    }
+    std::sort(tiles.begin(), tiles.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    return tiles;
+}
+
+bool ProjectionTileProfile::save(const std::string& path) const {
+    // each save has its own temporary file, two saves never write in the same one
+    const auto tmp_path = boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%.tmp").string();
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        for (const auto& tile : get_hottest_tiles()) {
+            out << tile.first << " " << tile.second << "\n";
+        }
+        if (!out) {
+            LOG_ERROR("Cannot write projection tile profile in " + tmp_path);
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Cannot move projection tile profile to " + path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t ProjectionTileProfile::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        LOG_INFO("No projection tile profile found in " + path);
+        return 0;
+    }
+    size_t nb_tiles = 0;
+    uint64_t id = 0, count = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    while (in >> id >> count) {
+        if (count / 2 > 0) {
+            counts[id] += count / 2;
+        }
+        ++nb_tiles;
+    }
+    return nb_tiles;
+}
+
+size_t warmup_tiles(baldr::GraphReader& graph,
+                    const std::vector<std::pair<uint64_t, uint64_t>>& hottest_tiles,
+                    size_t budget,
+                    const WarmupProgressCallback& on_progress) {
+    const size_t PAGE_SIZE = 4096;
+
+    size_t nb_loaded = 0;
+    size_t used = 0;
+    for (const auto& t : hottest_tiles) {
+        const baldr::GraphId id(t.first);
+        if (!graph.DoesTileExist(id)) {
+            continue;
+        }
+        const auto tile = graph.GetGraphTile(id);
+        if (!tile) {
+            continue;
+        }
+        const size_t size = tile->header()->end_offset();
+        if (used + size > budget) {
+            break;
+        }
+        used += size;
+
+        // Read a byte of each page, the volatile keeps the compiler from skipping it
+        const volatile char* memory = reinterpret_cast<const volatile char*>(tile->header());
+        char sum = 0;
+        for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+            sum ^= memory[offset];
+        }
+        (void)sum;
+
+        ++nb_loaded;
+        if (on_progress) {
+            on_progress(nb_loaded, hottest_tiles.size());
+        }
+    }
+    return nb_loaded;
+}
+
+} // namespace asgard
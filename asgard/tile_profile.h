@@ -0,0 +1,55 @@
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace valhalla {
+namespace baldr {
+class GraphReader;
+}
+} // namespace valhalla
+
+namespace asgard {
+
+// Count how often the requests project a location in each tile, to warm the hottest ones up on the next start.
+// Only the tile of the first edge of each projected location is counted, where the searches start from:
+// the tiles the searches expand through are not, so the warmup doesn't cover the whole routing.
+class ProjectionTileProfile : boost::noncopyable {
+public:
+    // Thread safe, tile_ids are the ids of the edges or of their tiles
+    void record(const std::vector<uint64_t>& tile_ids);
+
+    // Tiles sorted from the most used to the least used
+    std::vector<std::pair<uint64_t, uint64_t>> get_hottest_tiles() const;
+
+    // Write one "tile_id count" per line, through a temporary file of its own. Return false on error
+    bool save(const std::string& path) const;
+
+    // Add the counts of a saved profile, halved so that old habits fade out across restarts.
+    // Return the number of tiles read
+    size_t load(const std::string& path);
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, uint64_t> counts;
+};
+
+// Called after each tile with the number of tiles loaded and the total number of tiles to load
+using WarmupProgressCallback = std::function<void(size_t, size_t)>;
+
+// Load the hottest tiles in the graph's cache, as long as they fit in budget bytes,
+// and touch every page of their memory so that a memory mapped extract is read from the disk.
+// Return the number of tiles loaded
+size_t warmup_tiles(valhalla::baldr::GraphReader& graph,
+                    const std::vector<std::pair<uint64_t, uint64_t>>& hottest_tiles,
+                    size_t budget,
+                    const WarmupProgressCallback& on_progress = WarmupProgressCallback());
+
+} // namespace asgard